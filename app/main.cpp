@@ -8,6 +8,7 @@
 #include <iostream>
 #include <cstring>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 
 using namespace std;
@@ -18,6 +19,8 @@ using namespace std;
 #include "GraphNode.h"
 #include "Node.h"
 #include "Enclave.h"
+#include "GraphObliviousOperations.h"
+#include "GraphKeys.h"
 /*
  * Copyright (C) 2011-2018 Intel Corporation. All rights reserved.
  *
@@ -57,6 +60,8 @@ using namespace std;
 #include <stdio.h>
 #include <limits.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #ifndef SAFE_FREE
 #define SAFE_FREE(ptr) {if (NULL != (ptr)) {free(ptr); (ptr) = NULL;}}
@@ -118,21 +123,247 @@ void initializeEdgeList(vector<GraphNode> *edgeList, char **edges)
     }
 }
 
-int main(int argc, char *argv[]) {
-    (void) (argc);
-    (void) (argv);
+int algorithmOp(string alg)
+{
+    if (alg == "OBLIVIOUS-SSSP-OBLIVM" || alg == "OBLIVIOUS-SSSP-ARRAYHEAP" || alg == "OBLIVIOUS-SSSP-MULTI") {
+        return 3;
+    } else if (alg == "OBLIVIOUS-MST") {
+        return 2;
+    } else if (alg == "OBLIVIOUS-BFS" || alg == "OBLIVIOUS-BFS-BATCHED") {
+        return 1;
+    } else if (alg == "OBLIVIOUS-CC") {
+        return 4;
+    }
+    return -1;
+}
+
+/** Sources of OBLIVIOUS-SSSP-MULTI (--sources 1,5,9) */
+vector<int> multiSources = {1};
+/** PageRank iterations without --rounds */
+#define PAGERANK_ITERATIONS 20
+/**
+ * Fixed round count of the sort-scan algorithms (--rounds N), 0 = until
+ * stable; PageRank runs PAGERANK_ITERATIONS and label propagation V
+ * rounds if it is 0
+ */
+int fixedRounds = 0;
+
+void runAlgorithm(string alg, int src = 1)
+{
+    Utilities::startTimer(5);
+    if (alg == "SSSP-OBLIVM" || alg == "sssp-oblivm") {
+        cout << "Running SSSP-OBLIVM" << endl;
+        ecall_oblivm_single_source_shortest_path(src);
+    } else if (alg == "OBLIVIOUS-SSSP-OBLIVM" || alg == "oblivious-sssp-oblivm") {
+        cout << "Running Oblivious SSSP-OBLIVM" << endl;
+        ecall_oblivious_oblivm_single_source_shortest_path(src);
+    } else if (alg == "OBLIVIOUS-SSSP-ARRAYHEAP" || alg == "oblivious-sssp-arrayheap") {
+        cout << "Running Oblivious SSSP-OBLIVM on the array heap" << endl;
+        ecall_oblivious_array_heap_shortest_path(src);
+    } else if (alg == "OBLIVIOUS-SSSP-MULTI" || alg == "oblivious-sssp-multi") {
+        cout << "Running Oblivious multi-source SSSP from " << multiSources.size() << " sources" << endl;
+        ecall_oblivious_multi_source_shortest_path(multiSources.data(), multiSources.size());
+    } else if (alg == "OBLIVIOUS-SSSP-BF" || alg == "oblivious-sssp-bf") {
+        cout << "Running Oblivious Bellman-Ford SSSP" << endl;
+        ecall_oblivious_bellman_ford_shortest_path(src, NULL, fixedRounds);
+    } else if (alg == "OBLIVIOUS-MST" || alg == "oblivious-mst") {
+        cout << "Running Oblivious MST" << endl;
+        ecall_oblivious_minimum_spanning_tree();
+    } else if (alg == "OBLIVIOUS-CC" || alg == "oblivious-cc") {
+        cout << "Running Oblivious Connected Components" << endl;
+        ecall_oblivious_connected_components(NULL, fixedRounds);
+    } else if (alg == "OBLIVIOUS-PAGERANK" || alg == "oblivious-pagerank") {
+        cout << "Running Oblivious PageRank" << endl;
+        ecall_oblivious_pagerank(fixedRounds > 0 ? fixedRounds : PAGERANK_ITERATIONS);
+    } else if (alg == "OBLIVIOUS-LP" || alg == "oblivious-lp") {
+        cout << "Running Oblivious Label Propagation" << endl;
+        ecall_oblivious_label_propagation(fixedRounds);
+    } else if (alg == "OBLIVIOUS-BFS" || alg == "oblivious-bfs") {
+        cout << "Running Oblivious BFS" << endl;
+        ecall_oblivious_breadth_first_search(src);
+    } else if (alg == "OBLIVIOUS-BFS-BATCHED" || alg == "oblivious-bfs-batched") {
+        cout << "Running Oblivious batched BFS" << endl;
+        ecall_oblivious_breadth_first_search_batched(src, NULL, fixedRounds);
+    } else {
+        cout << "unknown algorithm" << endl;
+    }
+    auto exectime = Utilities::stopTimer(5);
+    cout << "Time:" << exectime << " Microseconds" << endl;
+}
+
+/**
+ * Runs one query of a served algorithm and stores the per-vertex result
+ */
+void runQuery(string alg, int src, int *distances)
+{
+    if (alg == "OBLIVIOUS-BFS") {
+        ecall_oblivious_breadth_first_search(src, distances);
+    } else if (alg == "OBLIVIOUS-BFS-BATCHED") {
+        ecall_oblivious_breadth_first_search_batched(src, distances, fixedRounds);
+    } else if (alg == "OBLIVIOUS-SSSP-BF") {
+        ecall_oblivious_bellman_ford_shortest_path(src, distances, fixedRounds);
+    } else if (alg == "OBLIVIOUS-SSSP-ARRAYHEAP") {
+        ecall_oblivious_array_heap_shortest_path(src, distances);
+    } else {
+        ecall_oblivious_oblivm_single_source_shortest_path(src, distances);
+    }
+}
+
+/**
+ * Answers shortest path (or BFS level) queries against the set-up graph,
+ * one source vertex per line. Each answer is the list of distances
+ * followed by "END".
+ * @return true if the client asked the server to shut down
+ */
+bool serveQueries(FILE *in, FILE *out, string alg)
+{
+    int vertexNumber = ecall_vertex_number();
+    vector<int> distances(vertexNumber);
+    char line[256];
+    while (fgets(line, sizeof (line), in) != NULL) {
+        string request(line);
+        request.erase(request.find_last_not_of(" \r\n") + 1);
+        if (request == "quit") {
+            return false;
+        } else if (request == "shutdown") {
+            return true;
+        }
+        int src = atoi(request.c_str());
+        if (src < 1 || src > vertexNumber) {
+            fprintf(out, "ERROR invalid source vertex\nEND\n");
+            fflush(out);
+            continue;
+        }
+        Utilities::startTimer(5);
+        runQuery(alg, src, distances.data());
+        auto exectime = Utilities::stopTimer(5);
+        for (int i = 1; i <= vertexNumber; i++) {
+            fprintf(out, "Destination:%d  Distance:%d\n", i, distances[i - 1]);
+        }
+        fprintf(out, "Time:%lld Microseconds\nEND\n", (long long) exectime);
+        fflush(out);
+    }
+    return false;
+}
+
+/**
+ * Serves queries on a unix domain socket until a client sends "shutdown"
+ */
+int serveSocket(string path, string alg)
+{
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return 1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof (addr.sun_path) - 1);
+    unlink(path.c_str());
+    if (bind(server, (struct sockaddr *) &addr, sizeof (addr)) < 0 || listen(server, 1) < 0) {
+        perror("bind");
+        close(server);
+        return 1;
+    }
+    cout << "Listening on " << path << endl;
+    bool shutdown = false;
+    while (!shutdown) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) {
+            perror("accept");
+            break;
+        }
+        FILE *in = fdopen(client, "r");
+        FILE *out = fdopen(dup(client), "w");
+        shutdown = serveQueries(in, out, alg);
+        fclose(out);
+        fclose(in);
+    }
+    close(server);
+    unlink(path.c_str());
+    return 0;
+}
 
+int runQueries(string alg, bool serve, string socketPath)
+{
+    if (!serve) {
+        runAlgorithm(alg);
+        return 0;
+    }
+    bool servable = (algorithmOp(alg) == 3 && alg != "OBLIVIOUS-SSSP-MULTI") || algorithmOp(alg) == 1 || alg == "OBLIVIOUS-SSSP-BF";
+    if (!servable) {
+        cerr << "Server mode only supports OBLIVIOUS-SSSP-OBLIVM, OBLIVIOUS-SSSP-ARRAYHEAP, OBLIVIOUS-SSSP-BF and OBLIVIOUS-BFS" << endl;
+        return 1;
+    }
+    if (socketPath != "") {
+        return serveSocket(socketPath, alg);
+    }
+    serveQueries(stdin, stdout, alg);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
     /* My Codes */
     int size = 0;
     string filename = "";
     string alg = "";
-    if (argc > 1) {
-        filename = string(argv[1]);
-        alg = string(argv[2]);
+    string setup = "OMAP";
+    string snapshot = "";
+    bool serve = false;
+    string socketPath = "";
+    vector<string> args;
+    for (int i = 1; i < argc; i++) {
+        string arg(argv[i]);
+        if (arg == "--serve") {
+            serve = true;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            GraphObliviousOperations::setSortThreads(atoi(argv[++i]));
+        } else if (arg == "--socket" && i + 1 < argc) {
+            serve = true;
+            socketPath = argv[++i];
+        } else if (arg == "--vertex-array") {
+            ecall_use_vertex_array(1);
+        } else if (arg == "--array-shards" && i + 1 < argc) {
+            ecall_use_vertex_array(atoi(argv[++i]));
+        } else if (arg == "--rounds" && i + 1 < argc) {
+            fixedRounds = atoi(argv[++i]);
+        } else if (arg == "--sources" && i + 1 < argc) {
+            multiSources.clear();
+            stringstream list(argv[++i]);
+            string src;
+            while (getline(list, src, ',')) {
+                multiSources.push_back(atoi(src.c_str()));
+            }
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() > 1) {
+        filename = args[0];
+        alg = args[1];
+        if (args.size() > 2) {
+            setup = args[2];
+        }
+        if (args.size() > 3) {
+            snapshot = args[3];
+        }
     } else {
         filename = "datasets/V13E-256.in";
         alg = "OBLIVIOUS-BFS";
     }
+
+    if (setup == "RESTORE") {
+        Utilities::startTimer(1);
+        int savedOp = ecall_restore_snapshot(filename.c_str());
+        auto timer = Utilities::stopTimer(1);
+        cout << "Restore Time:" << timer << "  Microseconds" << endl;
+        if (savedOp != algorithmOp(alg)) {
+            cerr << "Snapshot was set up for a different algorithm" << endl;
+            return 1;
+        }
+        return runQueries(alg, serve, socketPath);
+    }
     std::ifstream inFile(filename);
     size = std::count(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>(), '\n');
 
@@ -184,56 +415,41 @@ int main(int argc, char *argv[]) {
     int edgeNumner = edgeList.size();
     edgeList.clear();
 
-    for (int i = 1; i <= node_numebr; i++) {
-        string omapKey = "?" + to_string(i);
-        std::array< uint8_t, ID_SIZE > keyArray;
-        keyArray.fill(0);
-        std::copy(omapKey.begin(), omapKey.end(), std::begin(keyArray));
-        std::array<byte_t, ID_SIZE> id;
-        std::memcpy(id.data(), (const char*) keyArray.data(), ID_SIZE);
-        Bid inputBid(id);
-        pairs[inputBid] = "0-0";
-    }
-
-    std::cout << "Processed omaps" << std::endl;
-    constexpr unsigned long long storeBlockSize = (size_t)Z * (size_t)(blockSize);
-    initializeCiphertexts(&pairs, &ciphertexts);
-    setupMode = true;
-    ocall_setup_ramStore(blockCount, storeBlockSize);
-    ocall_nwrite_raw_ramStore(&ciphertexts);
-    std::cout << "Setup RAM store with " << blockCount << " blocks and " << storeBlockSize << " bytes" << std::endl;
-    Utilities::startTimer(1);
-    int op = -1;
-    if (alg == "OBLIVIOUS-SSSP-OBLIVM") {
-        op = 3;
-    } else if (alg == "OBLIVIOUS-MST") {
-        op = 2;
-    } else if (alg == "OBLIVIOUS-BFS") {
-        op = 1;
+    if (setup != "SORT") {
+        for (int i = 1; i <= node_numebr; i++) {
+            Bid inputBid(graphKey(DEGREE_KEY, i));
+            pairs[inputBid] = "0-0";
+        }
+
+        std::cout << "Processed omaps" << std::endl;
+        constexpr unsigned long long storeBlockSize = (size_t)Z * (size_t)(blockSize);
+        initializeCiphertexts(&pairs, &ciphertexts);
+        setupMode = true;
+        ocall_setup_ramStore(blockCount, storeBlockSize);
+        ocall_nwrite_raw_ramStore(&ciphertexts);
+        std::cout << "Setup RAM store with " << blockCount << " blocks and " << storeBlockSize << " bytes" << std::endl;
     }
+    Utilities::startTimer(1);
+    int op = algorithmOp(alg);
+    int instances = alg == "OBLIVIOUS-SSSP-MULTI" ? multiSources.size() : 0;
     std::cout << "Setting up " << edgeNumner << " edges" << std::endl;
 
-    ecall_setup_with_small_memory(edgeNumner, node_numebr, &edges, op);
+    if (setup == "SORT") {
+        ecall_setup_with_oblivious_sort(edgeNumner, node_numebr, &edges, op, instances);
+    } else {
+        ecall_setup_with_small_memory(edgeNumner, node_numebr, &edges, op, instances);
+    }
 
     auto timer = Utilities::stopTimer(1);
     cout << "Setup Time:" << timer << "  Microseconds" << endl;
 
-    Utilities::startTimer(5);
-    if (alg == "SSSP-OBLIVM" || alg == "sssp-oblivm") {
-        cout << "Running SSSP-OBLIVM" << endl;
-        ecall_oblivm_single_source_shortest_path(1);
-    } else if (alg == "OBLIVIOUS-SSSP-OBLIVM" || alg == "oblivious-sssp-oblivm") {
-        cout << "Running Oblivious SSSP-OBLIVM" << endl;
-        ecall_oblivious_oblivm_single_source_shortest_path(1);
-    } else {
-        cout << "unknown algorithm" << endl;
+    if (snapshot != "") {
+        Utilities::startTimer(1);
+        ecall_save_snapshot(snapshot.c_str());
+        timer = Utilities::stopTimer(1);
+        cout << "Snapshot Time:" << timer << "  Microseconds" << endl;
     }
-    auto exectime = Utilities::stopTimer(5);
-    cout << "Time:" << exectime << " Microseconds" << endl;
-
-
 
-
-    return 0;
+    return runQueries(alg, serve, socketPath);
 }
 
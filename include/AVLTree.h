@@ -146,6 +146,7 @@ public:
     void searchInsert(Node* head, Bid omapKey, string& res, string newValue);
     //    Node* search(Node* head, Bid key, int newPos = -1);
     string search(Node* head, Bid key);
+    vector<string> batchSearch(Node* rootNode, const vector<Bid>& keys, const vector<std::array<byte_t, 16> >* newValues = NULL, const vector<int>* writeModes = NULL);
     void printTree(Node* root, int indent);
     void startOperation(bool batchWrite = false);
     void setupInsert(Bid& rootKey, unsigned long long& rootPos, map<Bid, string>& pairs);
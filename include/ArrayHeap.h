@@ -0,0 +1,51 @@
+#ifndef ARRAYHEAP_H
+#define ARRAYHEAP_H
+
+#include "ObliviousArray.h"
+
+/**
+ * Binary min-heap of (id, dist) entries on two oblivious arrays: the heap
+ * slots, and the slot + 1 of every id (0 if the id is not in the heap) for
+ * decrease-key. It takes the operation codes of DOHEAP::execute and every
+ * operation makes the same sequence of array accesses, so the two heaps
+ * can be compared on the same SSSP loop.
+ */
+class ArrayHeap {
+private:
+
+    struct HeapEntry {
+        int id;
+        int dist;
+    };
+
+    ObliviousArray* entries;
+    ObliviousArray* slots;
+    int maxSize;
+    int idCount;
+    int size = 0;
+    /** sift steps of one operation, the height of a full heap */
+    int levels;
+
+    static std::array<byte_t, 16> pack(HeapEntry entry);
+    static HeapEntry unpack(const std::array<byte_t, 16>& value);
+    static std::array<byte_t, 16> packSlot(int slot);
+    static int unpackSlot(const std::array<byte_t, 16>& value);
+    static HeapEntry select(HeapEntry a, HeapEntry b, int choice);
+
+public:
+    /**
+     * A heap of up to maxSize entries whose ids are in [0, idCount)
+     */
+    ArrayHeap(int maxSize, int idCount);
+    ~ArrayHeap();
+    void reset();
+
+    /**
+     * 1 extract-min (id = dist = -1 on an empty heap), 2 insert, 3 dummy,
+     * 4 decrease-key. Insert and decrease-key lower the dist of an id that
+     * is already in the heap and ignore a dist that is not lower.
+     */
+    void execute(int& id, int& dist, int op);
+};
+
+#endif /* ARRAYHEAP_H */
@@ -101,15 +101,13 @@ public:
         return result;
     }
 
-    static int CTcmp(Bid lhs, Bid rhs) {
-        int res = 0;
-        bool found = false;
-        for (int i = ID_SIZE - 1; i >= 0; i--) {
-            int cmpRes = CTcmp(lhs.id[i], rhs.id[i]);
-            res = conditional_select(cmpRes, res, !found);
-            found = conditional_select(true, found, !CTeq(cmpRes, 0) && !found);
-        }
-        return res;
+    /**
+     * constant time comparator of ids as little-endian numbers
+     * @return left < right -> -1,  left = right -> 0, left > right -> 1
+     */
+    static int CTcmp(const Bid& lhs, const Bid& rhs) {
+        static_assert(ID_SIZE == 16, "CTcmp128 compares 16-byte ids");
+        return CTcmp128(lhs.id.data(), rhs.id.data());
     }
 
     /**
@@ -8,8 +8,10 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <functional>
 #include "Bid.h"
 #include "LocalRAMStore.hpp"
+#include "ObliviousArray.h"
 
 using namespace std;
 
@@ -28,7 +30,6 @@ public:
     long long evictionNode;
     bool isDummy;
     //    int compactionLeft;
-    std::array< byte_t, 64> dum;
 
     static HeapNode* clone(HeapNode* oldNode) {
         HeapNode* newNode = new HeapNode();
@@ -38,7 +39,6 @@ public:
         newNode->value = oldNode->value;
         newNode->key = oldNode->key;
         newNode->isDummy = oldNode->isDummy;
-        newNode->dum = oldNode->dum;
         return newNode;
     }
 
@@ -116,9 +116,6 @@ public:
         b->index = HeapNode::conditional_select((long long) a->index, (long long) b->index, choice);
         b->isDummy = HeapNode::conditional_select(a->isDummy, b->isDummy, choice);
         b->pos = HeapNode::conditional_select((long long) a->pos, (long long) b->pos, choice);
-        for (int k = 0; k < b->dum.size(); k++) {
-            b->dum[k] = HeapNode::conditional_select(a->dum[k], b->dum[k], choice);
-        }
         b->evictionNode = HeapNode::conditional_select(a->evictionNode, b->evictionNode, choice);
         a->index = HeapNode::conditional_select((long long) tmp.index, (long long) a->index, choice);
         for (int k = 0; k < b->value.size(); k++) {
@@ -129,9 +126,6 @@ public:
         }
         a->isDummy = HeapNode::conditional_select(tmp.isDummy, a->isDummy, choice);
         a->pos = HeapNode::conditional_select((long long) tmp.pos, (long long) a->pos, choice);
-        for (int k = 0; k < b->dum.size(); k++) {
-            a->dum[k] = HeapNode::conditional_select(tmp.dum[k], a->dum[k], choice);
-        }
         a->evictionNode = HeapNode::conditional_select(tmp.evictionNode, a->evictionNode, choice);
     }
 
@@ -149,9 +143,6 @@ public:
         for (int k = 0; k < b->value.size(); k++) {
             a->value[k] = HeapNode::conditional_select(b->value[k], a->value[k], choice);
         }
-        for (int k = 0; k < b->dum.size(); k++) {
-            a->dum[k] = HeapNode::conditional_select(b->dum[k], a->dum[k], choice);
-        }
         a->evictionNode = HeapNode::conditional_select(b->evictionNode, a->evictionNode, choice);
         for (int k = 0; k < a->key.id.size(); k++) {
             a->key.id[k] = HeapNode::conditional_select(b->key.id[k], a->key.id[k], choice);
@@ -199,15 +190,51 @@ public:
     }
 };
 
-struct HeapBlock {
-    unsigned long long id;
-    block data;
+/**
+ * Smallest entry of a subtree: its key, value and leaf. index 0 means the
+ * subtree is empty.
+ */
+struct HeapMin {
+    Bid key;
+    std::array<byte_t, 16> value;
+    unsigned long long pos;
+    unsigned long long index;
+
+    /**
+     * constant time assign
+     * @param choice 0 or 1
+     */
+    void conditional_assign(const HeapMin& other, int choice) {
+        key = Bid::conditional_select(other.key, key, choice);
+        for (int k = 0; k < (int) value.size(); k++) {
+            value[k] = HeapNode::conditional_select(other.value[k], value[k], choice);
+        }
+        pos = HeapNode::conditional_select(other.pos, pos, choice);
+        index = HeapNode::conditional_select(other.index, index, choice);
+    }
+
+    /**
+     * Takes other if it holds an entry with a smaller key
+     */
+    void reduce(const HeapMin& other) {
+        bool smaller = Bid::CTeq(-1, Bid::CTcmp(other.key, key)) && !HeapNode::CTeq(other.index, (unsigned long long) 0);
+        conditional_assign(other, smaller);
+    }
 };
 
+/**
+ * Bucket as kept in the heap store. The header holds the keys, leaves and
+ * indexes of the Z slots next to each other (index 0 marks an empty slot)
+ * followed by the subtree minimum, so UpdateMin only scans the header; the
+ * values come last. Buckets are copied to and from the store as they are.
+ */
 class HeapBucket {
 public:
-    std::array<HeapBlock, Z> blocks;
-    HeapBlock subtree_min;
+    std::array<Bid, Z> keys;
+    std::array<unsigned long long, Z> positions;
+    std::array<unsigned long long, Z> indexes;
+    HeapMin subtree_min;
+    std::array<std::array<byte_t, 16>, Z> values;
 };
 
 class HeapCache {
@@ -226,6 +253,18 @@ public:
 class DOHEAP {
 private:
 
+    /** State of an execute between BeginExecute and FinishExecute */
+    struct HeapOperation {
+        pair<Bid, array<byte_t, 16> > result;
+        HeapNode* minnode = NULL;
+        Bid key;
+        array<byte_t, 16> value;
+        bool isExtract;
+        bool moveNode;
+        long long newLeaf;
+        long long secondLeaf;
+    };
+
     unsigned int PERMANENT_STASH_SIZE;
 
     std::random_device rd;
@@ -245,30 +284,58 @@ private:
     LocalRAMStore* localStore;
     bool useLocalRamStore = false;
     int storeBlockSize;
+    long long storeOffset = 0;
+    /**
+     * leaf + 1 (0 if there is none) and the low 8 key bytes of the entry
+     * holding value i, NULL without decreaseKeys
+     */
+    ObliviousArray* positionMap = NULL;
+    int positionCount = 0;
+    HeapOperation pending;
+    /** subtree_min of the root bucket as of the last flush */
+    HeapMin rootMin;
+    bool rootMinCached = false;
 
 
     long long GetNodeOnPath(long long leaf, int depth);
 
     void FetchPath(long long leaf);
 
-    block SerialiseBucket(HeapBucket bucket);
-    HeapBucket DeserialiseBucket(block buffer);
+    static block SerialiseBucket(const HeapBucket& bucket);
+    static HeapBucket DeserialiseBucket(const byte_t* buffer);
+    void StashBucket(const HeapBucket& bucket);
+    static void SetSlot(HeapBucket& bucket, int z, HeapNode* node);
+    static HeapNode* MinNode(const HeapMin& min);
+    static HeapMin SlotsMin(const HeapBucket& bucket);
+    void StoreBuckets(vector<long long>& indexes, vector<HeapBucket>& buckets);
+    void BuildPositions(const vector<pair<Bid, array<byte_t, 16> > >& items, const vector<long long>& leaves);
 
-    vector<HeapBucket> ReadBuckets(vector<long long> indexes);
     void InitializeBuckets(long long strtindex, long long endindex, HeapBucket bucket);
+    void InitializeHeapBuckets();
+    void InitializeStash();
     void WriteBuckets(vector<long long> indexes, vector<HeapBucket> buckets);
     void EvictBuckets();
+    static void EvictBuckets(const vector<DOHEAP*>& heaps);
     void UpdateMin();
+    vector<long long> PathBuckets(long long leaf);
+    void LoadBuckets(const vector<long long>& indexes);
+    static void LoadBuckets(const vector<DOHEAP*>& heaps, const vector<vector<long long> >& indexes);
+    vector<long long> BeginExecute(Bid k, array<byte_t, 16> v, int op);
+    pair<Bid, array<byte_t, 16> > FinishExecute();
+    HeapMin RootMin();
+    vector<long long> StoreIndexes(const vector<long long>& indexes);
+    void AccessPosition(int value, const function<void(long long&, Bid&)>& update);
+    static int ValueIndex(const array<byte_t, 16>& v);
 
 
 
     bool WasSerialised();
-    HeapNode* convertBlockToNode(block b);
-    block convertNodeToBlock(HeapNode* node);
     void WriteBucket(long long index, HeapBucket bucket);
 
 public:
-    DOHEAP(long long maxSize, bool simulation);
+    DOHEAP(long long maxSize, bool simulation, long long storeOffset = -1, bool decreaseKeys = false, long long positionOffset = -1);
+    static long long StoreSlots(long long maxSize);
+    static long long PositionSlots(long long maxSize);
     DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long long, unsigned long long> permutation);
     ~DOHEAP();
     double evicttime = 0;
@@ -281,11 +348,15 @@ public:
 
     unsigned long long RandomPath();
     void start(bool batchWrite);
+    void reset();
     void insert(Bid k, array< byte_t, 16> v);
     pair<Bid,array<byte_t, 16> > extractMin();
     array< byte_t, 16> findMin();
     void dummy();
+    void decreaseKey(Bid k, array<byte_t, 16> v);
+    void buildHeap(const vector<pair<Bid, array<byte_t, 16> > >& items);
     pair<Bid,array<byte_t, 16> > execute(Bid k, array<byte_t, 16> v, int op);
+    static vector<pair<Bid, array<byte_t, 16> > > executeBatch(const vector<DOHEAP*>& heaps, const vector<Bid>& keys, const vector<array<byte_t, 16> >& values, const vector<int>& ops);
     void evict(bool evictBuckets = false);
     bool profile = false;
 };
@@ -2,6 +2,21 @@
 #include "ORAMEnclaveInterface.h"
 #include "Common.h"
 
-void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList, int op);
-void ecall_oblivious_oblivm_single_source_shortest_path(int src);
+void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList, int op, int instances);
+void ecall_setup_with_oblivious_sort(int eSize, long long vSize, char **edgeList, int op, int instances);
+void ecall_use_vertex_array(int shards);
+void ecall_save_snapshot(const char *path);
+int ecall_restore_snapshot(const char *path);
+int ecall_vertex_number();
+void ecall_reset_query_state();
+void ecall_oblivious_oblivm_single_source_shortest_path(int src, int *distances = NULL);
+void ecall_oblivious_array_heap_shortest_path(int src, int *distances = NULL);
+void ecall_oblivious_multi_source_shortest_path(const int *sources, int k, int *distances = NULL);
+void ecall_oblivious_breadth_first_search(int src, int *levels = NULL);
+void ecall_oblivious_breadth_first_search_batched(int src, int *levels = NULL, int rounds = 0);
+void ecall_oblivious_bellman_ford_shortest_path(int src, int *distances = NULL, int rounds = 0);
+void ecall_oblivious_minimum_spanning_tree();
+int ecall_oblivious_connected_components(int *components = NULL, int rounds = 0);
+void ecall_oblivious_pagerank(int iterations, double *ranks = NULL);
+void ecall_oblivious_label_propagation(int iterations, int *labels = NULL);
 void ecall_oblivm_single_source_shortest_path(int src);
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef GRAPHKEYS_H
+#define GRAPHKEYS_H
+
+#include "KeyValueOperations.h"
+
+/**
+ * Namespaces of the graph OMAP. A key is the tag byte followed by up to two
+ * little-endian 32-bit ints and zero padding, so keys are built without any
+ * formatting and compared as two 64-bit words (see Bid::CTcmp).
+ */
+enum GraphKeyTag : byte_t {
+    OUT_EDGE_KEY = '$', // (src, k) -> "dst-weight"
+    IN_EDGE_KEY = '*', // (dst, k) -> "src-weight"
+    EDGE_KEY = '!', // (src, dst) -> "weight-out-in"
+    DEGREE_KEY = '?', // (v) -> "out-in"
+    VERTEX_KEY = '/', // (v) -> distance or label, (v, j) -> distance of source j
+    HEAP_KEY = '&', // (slot) -> "v-dist"
+    QUEUE_KEY = '@', // (slot) -> "v-level"
+    LEVEL_KEY = '%', // (v) -> level
+    DUMMY_KEY = '=' // padding accesses
+};
+
+/**
+ * Key of the given namespace
+ */
+constexpr fixed_kv graphKey(byte_t tag, int a, int b = 0) {
+    fixed_kv key{};
+    key[0] = tag;
+    for (int i = 0; i < 4; i++) {
+        key[1 + i] = (byte_t) ((unsigned int) a >> (8 * i));
+        key[5 + i] = (byte_t) ((unsigned int) b >> (8 * i));
+    }
+    return key;
+}
+
+static_assert(graphKey(VERTEX_KEY, 258)[2] == 1, "graph keys are little-endian");
+
+#endif /* GRAPHKEYS_H */
@@ -0,0 +1,173 @@
+#ifndef GRAPHOBLIVIOUSOPERATIONS_H
+#define GRAPHOBLIVIOUSOPERATIONS_H
+
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <thread>
+#include "Node.h"
+
+using namespace std;
+
+/** Word type that may alias any record type (records can hold doubles) */
+typedef uint32_t __attribute__((__may_alias__)) record_word_t;
+
+/** Sub-sorts and merges smaller than this stay on the calling thread */
+#define PARALLEL_SORT_THRESHOLD 4096
+
+/**
+ * Oblivious sorting over flat graph records (edges, vertex entries, ...).
+ * Records are ordered by a 64-bit key extracted by the caller, and the
+ * sequence of compare-and-swaps only depends on the number of records.
+ */
+class GraphObliviousOperations {
+private:
+    template <typename T, typename KeyFn>
+    static void bitonic_sort(vector<T>* items, KeyFn& key, int low, int n, int dir, int threads);
+    template <typename T, typename KeyFn>
+    static void bitonic_merge(vector<T>* items, KeyFn& key, int low, int n, int dir, int threads);
+    template <typename T, typename KeyFn>
+    static void compare_and_swap_range(vector<T>* items, KeyFn& key, int begin, int end, int m, int dir);
+    static int greatest_power_of_two_less_than(int n);
+    static int sortThreads;
+
+public:
+    GraphObliviousOperations();
+    virtual ~GraphObliviousOperations();
+
+    /**
+     * constant time comparator for unsigned sort keys
+     * @return left < right -> -1,  left = right -> 0, left > right -> 1
+     */
+    static int CTcmp(unsigned long long lhs, unsigned long long rhs);
+
+    /**
+     * constant time swap of two records
+     * @param choice 0 or 1
+     */
+    template <typename T>
+    static void conditional_swap(T* a, T* b, int choice);
+
+    /**
+     * constant time select of two records
+     * @return a if choice is 1, b if choice is 0
+     */
+    template <typename T>
+    static T conditional_select(const T& a, const T& b, int choice);
+
+    /**
+     * constant time bytewise equality of two records
+     */
+    template <typename T>
+    static bool CTequal(const T& a, const T& b);
+
+    /**
+     * Sorts the records in ascending order of key(record)
+     */
+    template <typename T, typename KeyFn>
+    static void bitonicSort(vector<T>* items, KeyFn key);
+
+    /**
+     * Number of threads bitonicSort may use. The compare-and-swap sequence
+     * is the same for any thread count.
+     */
+    static void setSortThreads(int threads);
+};
+
+template <typename T>
+void GraphObliviousOperations::conditional_swap(T* a, T* b, int choice) {
+    static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+    static_assert(sizeof (T) % sizeof (uint32_t) == 0, "records must be a multiple of 4 bytes");
+    record_word_t* x = reinterpret_cast<record_word_t*> (a);
+    record_word_t* y = reinterpret_cast<record_word_t*> (b);
+    uint32_t mask = (uint32_t) 0 - (uint32_t) choice;
+    for (size_t i = 0; i < sizeof (T) / sizeof (uint32_t); i++) {
+        uint32_t t = (x[i] ^ y[i]) & mask;
+        x[i] ^= t;
+        y[i] ^= t;
+    }
+}
+
+template <typename T>
+T GraphObliviousOperations::conditional_select(const T& a, const T& b, int choice) {
+    T result = b;
+    T other = a;
+    conditional_swap(&result, &other, choice);
+    return result;
+}
+
+template <typename T>
+bool GraphObliviousOperations::CTequal(const T& a, const T& b) {
+    static_assert(std::is_trivially_copyable<T>::value, "records must be trivially copyable");
+    static_assert(sizeof (T) % sizeof (uint32_t) == 0, "records must be a multiple of 4 bytes");
+    const record_word_t* x = reinterpret_cast<const record_word_t*> (&a);
+    const record_word_t* y = reinterpret_cast<const record_word_t*> (&b);
+    uint32_t diff = 0;
+    for (size_t i = 0; i < sizeof (T) / sizeof (uint32_t); i++) {
+        diff |= x[i] ^ y[i];
+    }
+    return Node::CTeq((int) diff, 0);
+}
+
+template <typename T, typename KeyFn>
+void GraphObliviousOperations::bitonicSort(vector<T>* items, KeyFn key) {
+    int len = items->size();
+    bitonic_sort(items, key, 0, len, 1, sortThreads);
+}
+
+template <typename T, typename KeyFn>
+void GraphObliviousOperations::bitonic_sort(vector<T>* items, KeyFn& key, int low, int n, int dir, int threads) {
+    if (n > 1) {
+        int middle = n / 2;
+        if (threads > 1 && n >= PARALLEL_SORT_THRESHOLD) {
+            std::thread left([&]() {
+                bitonic_sort(items, key, low, middle, !dir, threads / 2);
+            });
+            bitonic_sort(items, key, low + middle, n - middle, dir, threads - threads / 2);
+            left.join();
+        } else {
+            bitonic_sort(items, key, low, middle, !dir, 1);
+            bitonic_sort(items, key, low + middle, n - middle, dir, 1);
+        }
+        bitonic_merge(items, key, low, n, dir, threads);
+    }
+}
+
+template <typename T, typename KeyFn>
+void GraphObliviousOperations::compare_and_swap_range(vector<T>* items, KeyFn& key, int begin, int end, int m, int dir) {
+    for (int i = begin; i < end; i++) {
+        int cmp = Node::CTeq(CTcmp(key((*items)[i]), key((*items)[i + m])), 1);
+        conditional_swap(&(*items)[i], &(*items)[i + m], Node::CTeq(cmp, dir));
+    }
+}
+
+template <typename T, typename KeyFn>
+void GraphObliviousOperations::bitonic_merge(vector<T>* items, KeyFn& key, int low, int n, int dir, int threads) {
+    if (n > 1) {
+        int m = greatest_power_of_two_less_than(n);
+        if (threads > 1 && n >= PARALLEL_SORT_THRESHOLD) {
+            vector<std::thread> workers;
+            int chunk = (n - m + threads - 1) / threads;
+            for (int begin = low; begin < low + n - m; begin += chunk) {
+                int end = min(begin + chunk, low + n - m);
+                workers.push_back(std::thread([ = , &key]() {
+                    compare_and_swap_range(items, key, begin, end, m, dir);
+                }));
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            std::thread left([&]() {
+                bitonic_merge(items, key, low, m, dir, threads / 2);
+            });
+            bitonic_merge(items, key, low + m, n - m, dir, threads - threads / 2);
+            left.join();
+        } else {
+            compare_and_swap_range(items, key, low, low + n - m, m, dir);
+            bitonic_merge(items, key, low, m, dir, 1);
+            bitonic_merge(items, key, low + m, n - m, dir, 1);
+        }
+    }
+}
+
+#endif /* GRAPHOBLIVIOUSOPERATIONS_H */
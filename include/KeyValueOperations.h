@@ -0,0 +1,168 @@
+#ifndef KEYVALUEOPERATIONS_H
+#define KEYVALUEOPERATIONS_H
+
+#include <string>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "Node.h"
+
+/** Zero-padded OMAP key (see GraphKeys.h) or value ("7-250", ...) */
+using fixed_kv = bytes<16>;
+
+/**
+ * Constant-time building, selecting and parsing of fixed_kv keys and
+ * values without string allocations. Integers are formatted and parsed
+ * with the same sequence of operations whatever their value, and the
+ * write position of a field never decides which bytes are touched.
+ */
+class KeyValueOperations {
+public:
+
+    /**
+     * fixed_kv holding a public constant such as "0-0"
+     */
+    static fixed_kv make(const char* text) {
+        fixed_kv result;
+        result.fill(0);
+        std::memcpy(result.data(), text, std::min(strlen(text), result.size()));
+        return result;
+    }
+
+    /**
+     * Writes c at position pos
+     * @return position after c
+     */
+    static int writeChar(fixed_kv& kv, int pos, byte_t c) {
+        for (int t = 0; t < (int) kv.size(); t++) {
+            kv[t] = Node::conditional_select(c, kv[t], Node::CTeq(t, pos));
+        }
+        return pos + 1;
+    }
+
+    /**
+     * Writes the decimal form of value (as to_string does) at position pos.
+     * Digits past the end of kv are dropped.
+     * @return position after the last digit
+     */
+    static int writeInt(fixed_kv& kv, int pos, int value) {
+        int negative = (int) ((unsigned int) value >> 31);
+        long long magnitude = Node::conditional_select(-(long long) value, (long long) value, negative);
+        byte_t digits[10];
+        long long rest = magnitude;
+        for (int k = 9; k >= 0; k--) {
+            digits[k] = (byte_t) ('0' + rest % 10);
+            rest /= 10;
+        }
+        int length = 1;
+        long long bound = 10;
+        for (int k = 1; k < 10; k++) {
+            length += !Node::CTeq(Node::CTcmp(magnitude, bound), -1);
+            bound *= 10;
+        }
+        for (int m = 0; m < 11; m++) {
+            int source = 10 - length + m - negative;
+            byte_t c = '-';
+            for (int j = 0; j < 10; j++) {
+                c = Node::conditional_select(digits[j], c, Node::CTeq(j, source));
+            }
+            c = Node::conditional_select((byte_t) '-', c, negative && Node::CTeq(m, 0));
+            bool valid = Node::CTeq(Node::CTcmp(m, negative + length), -1);
+            for (int t = 0; t < (int) kv.size(); t++) {
+                kv[t] = Node::conditional_select(c, kv[t], valid && Node::CTeq(t, pos + m));
+            }
+        }
+        return pos + negative + length;
+    }
+
+    /**
+     * "a-b" value
+     */
+    static fixed_kv pair(int a, int b) {
+        fixed_kv result;
+        result.fill(0);
+        int pos = writeInt(result, 0, a);
+        pos = writeChar(result, pos, '-');
+        writeInt(result, pos, b);
+        return result;
+    }
+
+    /**
+     * decimal value
+     */
+    static fixed_kv number(int a) {
+        fixed_kv result;
+        result.fill(0);
+        writeInt(result, 0, a);
+        return result;
+    }
+
+    /**
+     * constant time select
+     * @return a if choice is 1, b if choice is 0
+     */
+    static fixed_kv select(const fixed_kv& a, const fixed_kv& b, int choice) {
+        fixed_kv result;
+#ifdef __SSE2__
+        __m128i mask = _mm_set1_epi8((char) -(choice & 1));
+        __m128i x = _mm_loadu_si128((const __m128i*) a.data());
+        __m128i y = _mm_loadu_si128((const __m128i*) b.data());
+        _mm_storeu_si128((__m128i*) result.data(), _mm_or_si128(_mm_and_si128(mask, x), _mm_andnot_si128(mask, y)));
+#else
+        uint64_t x[2], y[2];
+        std::memcpy(x, a.data(), sizeof (x));
+        std::memcpy(y, b.data(), sizeof (y));
+        uint64_t mask = (uint64_t) 0 - (uint64_t) (choice & 1);
+        for (int i = 0; i < 2; i++) {
+            x[i] = (x[i] & mask) | (y[i] & ~mask);
+        }
+        std::memcpy(result.data(), x, sizeof (x));
+#endif
+        return result;
+    }
+
+    /**
+     * constant time equality
+     */
+    static bool equal(const fixed_kv& a, const fixed_kv& b) {
+#ifdef __SSE2__
+        __m128i x = _mm_loadu_si128((const __m128i*) a.data());
+        __m128i y = _mm_loadu_si128((const __m128i*) b.data());
+        return Node::CTeq(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)), 0xFFFF);
+#else
+        uint64_t x[2], y[2];
+        std::memcpy(x, a.data(), sizeof (x));
+        std::memcpy(y, b.data(), sizeof (y));
+        return Node::CTeq((unsigned long long) ((x[0] ^ y[0]) | (x[1] ^ y[1])), 0ULL);
+#endif
+    }
+
+    static bool isEmpty(const fixed_kv& kv) {
+        return Node::CTeq((int) kv[0], 0);
+    }
+
+    /**
+     * Non-negative integer field index (0 or 1) of an "a-b" value, or of a
+     * plain number for index 0. Missing fields read as 0.
+     */
+    static int field(const fixed_kv& kv, int index) {
+        int result = 0;
+        int separators = 0;
+        bool done = false;
+        for (int i = 0; i < (int) kv.size(); i++) {
+            done = done || Node::CTeq((int) kv[i], 0);
+            bool separator = Node::CTeq((int) kv[i], '-');
+            bool take = !done && !separator && Node::CTeq(separators, index);
+            result = Node::conditional_select(result * 10 + (kv[i] - '0'), result, take);
+            separators += !done && separator;
+        }
+        return result;
+    }
+
+    static std::string toString(const fixed_kv& kv) {
+        return std::string((const char*) kv.data(), strnlen((const char*) kv.data(), kv.size()));
+    }
+};
+
+#endif /* KEYVALUEOPERATIONS_H */
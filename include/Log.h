@@ -0,0 +1,35 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <cstdio>
+
+/**
+ * Compile-time log levels. A message above GRAPHOS_LOG_LEVEL compiles to
+ * nothing (its arguments are still type-checked), so benchmarks measure
+ * ORAM cost and not terminal I/O. Set the level with the GRAPHOS_LOG_LEVEL
+ * CMake option. Results of a query are program output and always printed.
+ */
+#define LOG_LEVEL_NONE 0
+/** setup steps and their timings */
+#define LOG_LEVEL_INFO 1
+/** progress of the query loops, once per iteration */
+#define LOG_LEVEL_DEBUG 2
+/** state of single ORAM/heap operations; reveals the access pattern */
+#define LOG_LEVEL_TRACE 3
+
+#ifndef GRAPHOS_LOG_LEVEL
+#define GRAPHOS_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define GRAPHOS_LOG(level, ...) \
+    do { \
+        if constexpr ((level) <= GRAPHOS_LOG_LEVEL) { \
+            printf(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_INFO(...) GRAPHOS_LOG(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DEBUG(...) GRAPHOS_LOG(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_TRACE(...) GRAPHOS_LOG(LOG_LEVEL_TRACE, __VA_ARGS__)
+
+#endif /* LOG_H */
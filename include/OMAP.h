@@ -36,6 +36,10 @@ public:
     string atomicReadAndSetDist(Bid key, string value);
     void atomicInsert(Bid key, string value);
     string atomicFind(Bid omapKey);
+    void checkpoint(block& state);
+    static OMAP* restore(int maxSize, const byte_t*& cursor);
+    void rewritePrefix(string prefix, string value);
+    vector<string> multiAccess(const vector<Bid>& keys, const vector<string>& values, const vector<int>& writeModes);
 };
 
 #endif /* OMAP_H */
@@ -8,6 +8,9 @@
 #include <iostream>
 #include <map>
 #include <set>
+#include <functional>
+#include <deque>
+#include <thread>
 #include "Bid.h"
 #include "LocalRAMStore.hpp"
 #include "Node.h"
@@ -19,6 +22,13 @@ extern int BlockDummySize;
 
 #define BATCH_SIZE 16384
 
+/** How a value-writing ReadWrite updates the target node */
+enum ValueWriteMode {
+    WRITE_NONE = 0,     // leave the value as it is
+    WRITE_ALWAYS = 1,   // overwrite it
+    WRITE_IF_LESS = 2   // overwrite it if the new decimal value is smaller
+};
+
 class Cache {
 public:
     vector<Node*> nodes;
@@ -93,9 +103,22 @@ private:
     block convertNodeToBlock(Node* node);
 
     void beginOperation();
+    deque<unsigned long long> plannedLeaves;
+    /** store read of the next search path, running while this access evicts */
+    std::thread prefetchThread;
+    vector<long long> prefetchIndexes;
+    unordered_map<long long, int> prefetchSlots;
+    vector<char> prefetchBuffer;
+    size_t prefetchReadSize = 0;
+    void StartPrefetch(unsigned long long leaf);
+    void AwaitPrefetch();
+    void PrefetchNextLeaf(Node* res, Bid targetNode, bool isDummy);
+    unsigned long long nextFetchLeaf();
     vector<string> split(const string& str, const string& delim);
 
 public:
+    /** Leading decimal number of a value, the order of WRITE_IF_LESS */
+    static long long decimalValue(const std::array< byte_t, 16>& value);
     ORAM(long long maxSize, bool simulation, bool isEmptyMap);
     ORAM(long long maxSize, int nodesSize);
     void InitializeORAMBuckets();
@@ -118,11 +141,17 @@ public:
     //-----------------------------------------------------------
     bool evictBuckets = false; //is used for AVL calls. It should be set the same as values in default values
     //-----------------------------------------------------------
+    /**
+     * Set by a search loop when another step follows this one. The search
+     * ReadWrite then predicts the leaf of that step and reads its path on a
+     * separate thread while it evicts.
+     */
+    bool prefetchNextPath = false;
 
     Node* ReadWrite(Bid bid, Node* node, unsigned long long lastLeaf, unsigned long long newLeaf, bool isRead, bool isDummy, bool isIncompleteRead);
     Node* ReadWriteTest(Bid bid, Node* node, unsigned long long lastLeaf, unsigned long long newLeaf, bool isRead, bool isDummy, bool isIncompleteRead);
     Node* ReadWrite(Bid bid, Node* node, unsigned long long lastLeaf, unsigned long long newLeaf, bool isRead, bool isDummy, std::array< byte_t, 16> value, bool overwrite, bool isIncompleteRead);
-    Node* ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, std::array< byte_t, 16> newVec);
+    Node* ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, std::array< byte_t, 16> newVec, int writeMode = WRITE_ALWAYS);
     Node* ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, string part, bool isFirstPart);
     Node* ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, bool isFirstPart);
     Node* ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode);
@@ -132,6 +161,11 @@ public:
     void evict(bool evictBuckets);
     void setupInsert(vector<Node*>* nodes);
     void finilize(bool noDummyOp = false);
+    void checkpoint(block& state);
+    void restore(const byte_t*& cursor);
+    void scanAndRewrite(function<void(Node*) > rewrite);
+    unsigned long long planDummyLeaf();
+    void prefetchPaths(const vector<unsigned long long>& leaves);
     bool profile = false;
 };
 
@@ -2,7 +2,6 @@
 #define ORAMENCLAVEINTERFACE_H
 
 #include "OMAP.h"
-//#include "OHeap.h"
 #include "DOHEAP.hpp"
 #include <string>
 #include "Common.h"
@@ -13,10 +12,20 @@ void ecall_setup_oram(int max_size);
 void ecall_setup_omap_by_client(int max_size, const char *bid, long long rootPos);
 
 void ecall_setup_omap_with_small_memory(int max_size, long long initialSize);
-void ecall_setup_oheap(int maxSize);
+void ecall_checkpoint_omap(block *state);
+void ecall_restore_omap(int max_size, const byte_t **state);
+void ecall_setup_oheap(int maxSize, bool decreaseKeys = false);
 void ecall_set_new_minheap_node(int newMinHeapNodeV, int newMinHeapNodeDist);
 
 void ecall_execute_heap_operation(int *v, int *dist, int op);
+void ecall_build_oheap(const int *v, const int *dist, int count);
+void ecall_setup_oheaps(int count, int maxSize, bool decreaseKeys = false);
+void ecall_execute_heap_operation_on(int heap, int *v, int *dist, int op);
+void ecall_execute_heap_operations(int count, int *v, int *dist, const int *ops);
+void ecall_build_oheap_on(int heap, const int *v, const int *dist, int count);
+void ecall_setup_array_heap(int maxSize);
+void ecall_place_array_namespace(byte_t tag, int count, int width, int shards = 1);
+void ecall_execute_array_heap_operation(int *v, int *dist, int op);
 
 void ecall_dummy_heap_op();
 
@@ -29,6 +38,10 @@ void ecall_read_write_node(const char *bid, const char *value, char *oldValue);
 
 void ecall_write_node(const char *bid, const char *value);
 
+void ecall_multi_access_nodes(int count, const char *bids, const char *values, const int *writeModes, char *results);
+
+void ecall_rewrite_prefix(const char *prefix, const char *value);
+
 void ecall_start_setup();
 
 void ecall_end_setup();
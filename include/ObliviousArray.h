@@ -0,0 +1,102 @@
+#ifndef OBLIVIOUSARRAY_H
+#define OBLIVIOUSARRAY_H
+
+#include <functional>
+#include <random>
+#include <vector>
+#include "Types.h"
+
+using namespace std;
+
+/**
+ * Entry of an ObliviousArray bucket. index is the array index + 1, so 0
+ * marks an empty slot.
+ */
+struct ArrayBlock {
+    unsigned long long index;
+    unsigned long long pos;
+    std::array<byte_t, 16> value;
+};
+
+using ArrayBucket = std::array<ArrayBlock, Z>;
+
+/**
+ * Array stores: arrays set up per query (the array heap), graph namespaces
+ * placed at setup and the position maps of DOHEAPs, so none replaces
+ * another's store
+ */
+enum ArrayStoreId {
+    SCRATCH_ARRAY_STORE = 0,
+    GRAPH_ARRAY_STORE = 1,
+    HEAP_ARRAY_STORE = 2
+};
+
+/** Array sizes up to which the position map is scanned in the enclave */
+#define POSITION_SCAN_SIZE 1024
+/** Leaves per entry of a recursive position map */
+#define LEAVES_PER_ENTRY 4
+
+/**
+ * Array of 16-byte values on Path ORAM, addressed by index. An access
+ * reads one path and writes it back, with one array store ocall each and
+ * without the AVL lookups of the OMAP. Entries that were never written
+ * read as zero. Up to POSITION_SCAN_SIZE entries the position map stays in
+ * the enclave and is scanned in full on every access; larger arrays keep
+ * it in a recursive ObliviousArray of four leaves per entry.
+ */
+class ObliviousArray {
+private:
+    std::random_device rd;
+    std::mt19937 gen;
+    std::uniform_int_distribution<long long> dis;
+
+    long long size;
+    int depth;
+    long long maxOfRandom;
+    long long bucketCount;
+    long long storeOffset;
+    int store;
+    /** leaf of each index, if there is no positionMap */
+    vector<unsigned long long> positions;
+    /** leaf + 1 of each index (0 before its first access) */
+    ObliviousArray* positionMap = NULL;
+    /** fixed-size stash, index 0 marks a free slot */
+    vector<ArrayBlock> stash;
+
+    unsigned long long RandomPath();
+    unsigned long long UpdatePosition(long long index, unsigned long long leaf);
+    vector<long long> PathBuckets(unsigned long long leaf);
+    void StashBlock(const ArrayBlock& block, bool real);
+    void ReadPath(const vector<long long>& path);
+    void EvictPath(unsigned long long leaf, const vector<long long>& path);
+    void InitializeBuckets();
+
+public:
+    ObliviousArray(long long size, long long storeOffset = -1, int store = SCRATCH_ARRAY_STORE);
+    ~ObliviousArray();
+    static long long StoreSlots(long long size);
+    long long accessCount = 0;
+
+    /**
+     * Returns the value at index and replaces it by update(value). update
+     * runs on a copy whatever the index, so it must not branch on the value.
+     */
+    std::array<byte_t, 16> access(long long index, const std::function<void(std::array<byte_t, 16>&)>& update);
+    /**
+     * Returns the value at index, and replaces it by value if write is set.
+     * Reads and writes make the same accesses.
+     */
+    std::array<byte_t, 16> access(long long index, const std::array<byte_t, 16>& value, bool write);
+    std::array<byte_t, 16> read(long long index);
+    void write(long long index, const std::array<byte_t, 16>& value);
+    /** Empties the array (every entry reads as zero) */
+    void reset();
+    /**
+     * Bulk load of the first values.size() entries, the rest read as zero.
+     * Blocks go to random leaves as they would after their first access,
+     * but the placement is not hidden, so values must be public.
+     */
+    void load(const vector<std::array<byte_t, 16> >& values);
+};
+
+#endif /* OBLIVIOUSARRAY_H */
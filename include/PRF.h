@@ -117,15 +117,13 @@ public:
         return result;
     }
 
-    static int CTcmp(PRF lhs, PRF rhs) {
-        int res = 0;
-        bool found = false;
-        for (int i = PRF_SIZE - 1; i >= 0; i--) {
-            int cmpRes = CTcmp(lhs.id[i], rhs.id[i]);
-            res = conditional_select(cmpRes, res, !found);
-            found = conditional_select(true, found, !CTeq(cmpRes, 0) && !found);
-        }
-        return res;
+    /**
+     * constant time comparator of ids as little-endian numbers
+     * @return left < right -> -1,  left = right -> 0, left > right -> 1
+     */
+    static int CTcmp(const PRF& lhs, const PRF& rhs) {
+        static_assert(PRF_SIZE == 16, "CTcmp128 compares 16-byte ids");
+        return CTcmp128(lhs.id.data(), rhs.id.data());
     }
 
     /**
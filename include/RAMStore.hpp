@@ -4,6 +4,7 @@
 #include <array>
 #include <vector>
 #include <cstdlib>
+#include <ostream>
 
 using namespace std;
 
@@ -13,9 +14,16 @@ using block = std::vector<byte_t>;
 class RAMStore {
     std::vector<block> store;
     bool simulation;
+    const byte_t* image = NULL;
+    size_t imageCount = 0;
+    size_t imageBlockSize = 0;
+    /** mapping the image lies in, unmapped with the store */
+    void* mapping = NULL;
+    size_t mappingLength = 0;
 
 public:
     RAMStore(size_t num, bool simulation);
+    RAMStore(size_t num, const byte_t* image, size_t imageCount, size_t imageBlockSize, void* mapping, size_t mappingLength);
     ~RAMStore();
     std::vector<block> tmpstore;
     std::vector<block> prfstore;
@@ -27,5 +35,9 @@ public:
     void CreateRawStore(size_t count);
     void WriteRawStore(long long pos, block b);
     block ReadRawStore(long long pos);
+    size_t Size();
+    size_t ImageCount();
+    size_t ImageBlockSize();
+    void WriteImage(std::ostream& out);
 
 };
@@ -6,12 +6,16 @@
 extern bool setupMode;
 void ocall_setup_heapStore(size_t num, int size);
 
+void ocall_setup_arrayStore(int store, size_t num, int size);
+
 void ocall_setup_ramStore(size_t num, int size);
 
 void ocall_nwrite_ramStore(size_t blockCount, long long *indexes, const char *blk, size_t len);
 
 void ocall_nwrite_heapStore(size_t blockCount, long long *indexes, const char *blk, size_t len);
 
+void ocall_nwrite_arrayStore(int store, size_t blockCount, long long *indexes, const char *blk, size_t len);
+
 void ocall_write_rawRamStore(long long index, const char *blk, size_t len);
 
 void ocall_write_prfRamStore(long long index, const char *blk, size_t len);
@@ -32,6 +36,8 @@ size_t ocall_nread_ramStore(size_t blockCount, long long *indexes, char *blk, si
 
 size_t ocall_nread_heapStore(size_t blockCount, long long *indexes, char *blk, size_t len);
 
+size_t ocall_nread_arrayStore(int store, size_t blockCount, long long *indexes, char *blk, size_t len);
+
 size_t ocall_read_rawRamStore(size_t index, char *blk, size_t len);
 
 size_t ocall_read_prfRamStore(size_t index, char *blk, size_t len);
@@ -44,8 +50,13 @@ void ocall_initialize_ramStore(long long begin, long long end, const char *blk,
 
 void ocall_initialize_heapStore(long long begin, long long end, const char *blk, size_t len);
 
+void ocall_initialize_arrayStore(int store, long long begin, long long end, const char *blk, size_t len);
+
 void ocall_write_ramStore(long long index, const char *blk, size_t len);
 
 void ocall_write_heapStore(long long index, const char *blk, size_t len);
 
-void ocall_nwrite_prf(size_t blockCount, long long *indexes, const char *blk, size_t len);
\ No newline at end of file
+void ocall_nwrite_prf(size_t blockCount, long long *indexes, const char *blk, size_t len);
+void ocall_write_snapshot(const char *path, const char *state, size_t len);
+
+void ocall_map_snapshot(const char *path, block *state);
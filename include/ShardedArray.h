@@ -0,0 +1,87 @@
+#ifndef SHARDEDARRAY_H
+#define SHARDEDARRAY_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <openssl/evp.h>
+#include "ObliviousArray.h"
+
+/** Swap-or-not rounds of the index permutation per bit of the array size */
+#define SWAP_OR_NOT_ROUNDS_PER_BIT 6
+/** A batch overflows a shard with probability below 2^-SHARD_OVERFLOW_BITS */
+#define SHARD_OVERFLOW_BITS 40
+
+/**
+ * Oblivious array split into P ObliviousArray shards, each with its own
+ * stash, store region and RNG, so the shards of a batch are accessed on P
+ * threads at once. Index i lives in shard pi(i) mod P at pi(i) / P, for a
+ * secret permutation pi (swap-or-not over AES-128). A batch of n accesses
+ * gives every shard the same number of accesses, padded with dummies and
+ * routed by oblivious sorts, so which shards are accessed and how often
+ * depends on n alone. The shards run on P - 1 workers started with the
+ * array plus the calling thread, or all on the calling thread if the
+ * machine has a single hardware thread. Only namespaces placed with
+ * ecall_place_array_namespace are sharded; the OMAP, the heaps and the
+ * run store stay single instances, so independent queries share the
+ * array through the batches of the multi-source driver, not by running
+ * concurrently.
+ */
+class ShardedArray {
+private:
+
+    /** One access of a batch, or a padding access if real is 0 */
+    struct ShardRequest {
+        long long shard;
+        long long local;
+        int request;
+        int real;
+        int keep;
+        std::array<byte_t, 16> result;
+    };
+
+    long long size;
+    long long shardSize;
+    int shardCount;
+    vector<ObliviousArray*> shards;
+    int rounds;
+    vector<long long> roundKeys;
+    EVP_CIPHER_CTX* prf;
+
+    /** worker w runs shard w + 1 of each task; none on a single hardware thread */
+    vector<std::thread> workers;
+    /** guards task, generation, running and stop */
+    std::mutex poolMutex;
+    std::condition_variable poolChanged;
+    const std::function<void(int)>* task = NULL;
+    long long generation = 0;
+    int running = 0;
+    bool stop = false;
+
+    void Permute(vector<long long>& indexes);
+    void Work(int shard);
+    /** Runs task(p) for every shard p and waits for all of them */
+    void RunOnShards(const std::function<void(int)>& task);
+    vector<std::array<byte_t, 16> > DirectAccess(const vector<long long>& permuted, const std::function<void(int, std::array<byte_t, 16>&)>& update);
+
+public:
+    ShardedArray(long long size, int shardCount, long long storeOffset = -1, int store = GRAPH_ARRAY_STORE);
+    ~ShardedArray();
+    static long long StoreSlots(long long size, int shardCount);
+    /** Accesses each shard gets in a batch of n */
+    static long long ShardBatch(long long n, int shardCount);
+
+    /**
+     * Accesses the entries at indexes as one batch. Entry indexes[r] is
+     * replaced by update(r, value) and its old value is returned at r.
+     * Padding accesses call update too (on a copy), so it must not branch
+     * on its arguments and must be safe to call from several threads.
+     * Indexes that are written must be distinct.
+     */
+    vector<std::array<byte_t, 16> > access(const vector<long long>& indexes, const std::function<void(int, std::array<byte_t, 16>&)>& update);
+    /** Sets every entry to value, one shard per thread */
+    void fill(const std::array<byte_t, 16>& value);
+};
+
+#endif /* SHARDEDARRAY_H */
@@ -18,6 +18,10 @@
 #include <vector>
 #include <iostream>
 #include <cstdint>
+#include <cstring>
+#ifdef __SSE4_2__
+#include <nmmintrin.h>
+#endif
 
 #define ID_SIZE 16
 
@@ -60,5 +64,61 @@ T& from_bytes(const std::array< byte_t, sizeof (T) >& bytes, T& object) {
     return object;
 }
 
+template< typename T >
+void append_bytes(block& buffer, const T& object) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + sizeof (T));
+    std::memcpy(buffer.data() + offset, std::addressof(object), sizeof (T));
+}
+
+template< typename T >
+T& read_bytes(const byte_t*& cursor, T& object) {
+    std::memcpy(reinterpret_cast<byte_t*> (std::addressof(object)), cursor, sizeof (T));
+    cursor += sizeof (T);
+    return object;
+}
+
+/**
+ * constant time comparator of two 16-byte little-endian numbers (Bid and
+ * PRF ids). With SSE4.2 both 64-bit halves are compared at once with
+ * pcmpgtq; otherwise the halves are compared as words through 128-bit
+ * subtraction, or byte by byte on big-endian hosts.
+ * @return left < right -> -1,  left = right -> 0, left > right -> 1
+ */
+inline int CTcmp128(const byte_t* lhs, const byte_t* rhs) {
+#if defined(__SSE4_2__)
+    const __m128i bias = _mm_set1_epi64x((long long) 0x8000000000000000ULL);
+    __m128i l = _mm_xor_si128(_mm_loadu_si128((const __m128i*) lhs), bias);
+    __m128i r = _mm_xor_si128(_mm_loadu_si128((const __m128i*) rhs), bias);
+    // bit 0 is the low half, bit 1 the high half, which decides when set
+    int gt = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(l, r)));
+    int lt = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(r, l)));
+    int diff = gt - lt;
+    return (diff >> 31) | (int) ((unsigned int) -diff >> 31);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    unsigned long long l[2], r[2];
+    std::memcpy(l, lhs, sizeof (l));
+    std::memcpy(r, rhs, sizeof (r));
+    int cmp[2];
+    for (int i = 0; i < 2; i++) {
+        unsigned __int128 overflowing_iff_lt = (unsigned __int128) l[i] - (unsigned __int128) r[i];
+        unsigned __int128 overflowing_iff_gt = (unsigned __int128) r[i] - (unsigned __int128) l[i];
+        cmp[i] = (int) -(overflowing_iff_lt >> 127) + (int) (overflowing_iff_gt >> 127);
+    }
+    unsigned int highDiffers = (unsigned int) 0 - (unsigned int) (cmp[1] != 0);
+    return (int) ((highDiffers & (unsigned int) cmp[1]) | (~highDiffers & (unsigned int) cmp[0]));
+#else
+    int res = 0;
+    int found = 0;
+    for (int i = 15; i >= 0; i--) {
+        int cmp = (lhs[i] > rhs[i]) - (lhs[i] < rhs[i]);
+        unsigned int take = (unsigned int) 0 - (unsigned int) (!found & (cmp != 0));
+        res = (int) ((take & (unsigned int) cmp) | (~take & (unsigned int) res));
+        found |= cmp != 0;
+    }
+    return res;
+#endif
+}
+
 #endif /* TYPES_H */
 
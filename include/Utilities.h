@@ -1,6 +1,7 @@
 #ifndef UTILITIES_H
 #define UTILITIES_H
 #include <string>
+#include <array>
 #include <map>
 #include <vector>
 #include <fstream>
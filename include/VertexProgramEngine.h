@@ -0,0 +1,177 @@
+#ifndef VERTEXPROGRAMENGINE_H
+#define VERTEXPROGRAMENGINE_H
+
+#include <vector>
+#include <cstring>
+#include "GraphNode.h"
+#include "GraphObliviousOperations.h"
+
+using namespace std;
+
+/**
+ * Oblivious gather-apply-scatter over the padded GraphNode edge buffer.
+ * Every iteration sorts vertex and edge records by source to scatter the
+ * source state over the out-edges, then by destination to combine the
+ * messages of the in-edges and apply them to the vertex. All sorts and
+ * scans only depend on V and the number of edge slots.
+ *
+ * A Program provides the Value (vertex state) and Message types, which
+ * must be trivially copyable and a multiple of 4 bytes, and:
+ *   Value initial(int v)
+ *   Message identity()                       neutral element of combine
+ *   Message scatter(const Value& src, int outDegree, int weight)
+ *   Message combine(const Message& a, const Message& b)
+ *   Value apply(const Value& old, const Message& gathered)
+ * scatter, combine and apply must not branch on their arguments.
+ */
+template <typename Program>
+class VertexProgramEngine {
+public:
+    typedef typename Program::Value Value;
+    typedef typename Program::Message Message;
+
+    struct Record {
+        int src_id;
+        int dst_id;
+        int weight;
+        int isVertex;
+        int outDegree;
+        int pad;
+        Value value;
+        Message message;
+    };
+
+private:
+    Program program;
+    vector<Record> records;
+    int vertexNumber;
+
+    static unsigned long long bySource(const Record& r) {
+        return ((unsigned long long) (unsigned int) r.src_id << 1) | (unsigned long long) (1 - r.isVertex);
+    }
+
+    static unsigned long long byDestination(const Record& r) {
+        return ((unsigned long long) (unsigned int) r.dst_id << 1) | (unsigned long long) r.isVertex;
+    }
+
+    void countOutDegrees();
+
+public:
+    /**
+     * @param edges padded GraphNode buffer, edgeSize bytes per slot
+     * @param undirected also run every edge from dst to src
+     */
+    VertexProgramEngine(Program program, const char* edges, int edgeSlots, size_t edgeSize, int vertexNumber, bool undirected = false);
+
+    /**
+     * Runs the given number of iterations. With untilStable it stops after
+     * the first iteration that changes no vertex, which reveals the
+     * iteration count.
+     * @return number of iterations run
+     */
+    int run(int iterations, bool untilStable = false);
+
+    /**
+     * @return the state of the vertices 1..V, in order
+     */
+    vector<Value> values();
+};
+
+template <typename Program>
+VertexProgramEngine<Program>::VertexProgramEngine(Program program, const char* edges, int edgeSlots, size_t edgeSize, int vertexNumber, bool undirected)
+: program(program), vertexNumber(vertexNumber) {
+    int copies = undirected ? 2 : 1;
+    records.resize(copies * edgeSlots + vertexNumber);
+    for (int i = 0; i < edgeSlots; i++) {
+        GraphNode edge;
+        std::memcpy(&edge, edges + i * edgeSize, sizeof (GraphNode));
+        Record& r = records[i];
+        std::memset(&r, 0, sizeof (Record));
+        r.src_id = edge.src_id;
+        r.dst_id = edge.dst_id;
+        r.weight = edge.weight;
+        r.message = program.identity();
+        if (undirected) {
+            Record& back = records[edgeSlots + i];
+            back = r;
+            back.src_id = edge.dst_id;
+            back.dst_id = edge.src_id;
+        }
+    }
+    for (int v = 1; v <= vertexNumber; v++) {
+        Record& r = records[copies * edgeSlots + v - 1];
+        std::memset(&r, 0, sizeof (Record));
+        r.src_id = v;
+        r.dst_id = v;
+        r.isVertex = 1;
+        r.value = program.initial(v);
+        r.message = program.identity();
+    }
+    countOutDegrees();
+}
+
+template <typename Program>
+void VertexProgramEngine<Program>::countOutDegrees() {
+    GraphObliviousOperations::bitonicSort(&records, [](const Record & r) {
+        return ((unsigned long long) (unsigned int) r.src_id << 1) | (unsigned long long) r.isVertex;
+    });
+    int prev = -1, count = 0;
+    for (auto& r : records) {
+        bool same = Node::CTeq(r.src_id, prev);
+        count = Node::conditional_select(count, 0, same);
+        r.outDegree = Node::conditional_select(count, 0, r.isVertex);
+        count = count + 1 - r.isVertex;
+        prev = r.src_id;
+    }
+}
+
+template <typename Program>
+int VertexProgramEngine<Program>::run(int iterations, bool untilStable) {
+    int iteration = 0;
+    while (iteration < iterations) {
+        iteration++;
+        GraphObliviousOperations::bitonicSort(&records, bySource);
+        int prev = -1, degree = 0;
+        Value carry = program.initial(0);
+        for (auto& r : records) {
+            carry = GraphObliviousOperations::conditional_select(r.value, carry, r.isVertex);
+            degree = Node::conditional_select(r.outDegree, degree, r.isVertex);
+            prev = Node::conditional_select(r.src_id, prev, r.isVertex);
+            bool valid = !r.isVertex && Node::CTeq(r.src_id, prev);
+            r.message = GraphObliviousOperations::conditional_select(program.scatter(carry, degree, r.weight), program.identity(), valid);
+        }
+
+        GraphObliviousOperations::bitonicSort(&records, byDestination);
+        int changed = 0;
+        Message gathered = program.identity();
+        prev = -1;
+        for (auto& r : records) {
+            bool same = Node::CTeq(r.dst_id, prev);
+            gathered = GraphObliviousOperations::conditional_select(gathered, program.identity(), same);
+            Value next = program.apply(r.value, gathered);
+            changed |= r.isVertex && !GraphObliviousOperations::CTequal(next, r.value);
+            r.value = GraphObliviousOperations::conditional_select(next, r.value, r.isVertex);
+            gathered = GraphObliviousOperations::conditional_select(program.combine(gathered, r.message), gathered, !r.isVertex);
+            prev = r.dst_id;
+        }
+        if (untilStable && !changed) {
+            break;
+        }
+    }
+    return iteration;
+}
+
+template <typename Program>
+vector<typename Program::Value> VertexProgramEngine<Program>::values() {
+    GraphObliviousOperations::bitonicSort(&records, [](const Record & r) {
+        return ((unsigned long long) r.isVertex << 32) | (unsigned long long) (unsigned int) r.src_id;
+    });
+    vector<Value> result(vertexNumber);
+    size_t first = records.size() - vertexNumber;
+    for (int v = 0; v < vertexNumber; v++) {
+        result[v] = records[first + v].value;
+    }
+    return result;
+}
+
+#endif /* VERTEXPROGRAMENGINE_H */
@@ -0,0 +1,141 @@
+#ifndef VERTEXPROGRAMS_H
+#define VERTEXPROGRAMS_H
+
+#include "Node.h"
+
+/**
+ * Vertex programs for VertexProgramEngine
+ */
+
+/**
+ * PageRank with a fixed damping factor: every vertex spreads its rank
+ * evenly over its out-edges and takes (1 - d) / V + d * (sum of the
+ * incoming shares). Rank on vertices without out-edges is not
+ * redistributed.
+ */
+struct PageRankProgram {
+    typedef double Value;
+    typedef double Message;
+
+    int vertexNumber;
+    double damping;
+
+    Value initial(int v) const {
+        return 1.0 / vertexNumber;
+    }
+
+    Message identity() const {
+        return 0.0;
+    }
+
+    Message scatter(const Value& rank, int outDegree, int weight) const {
+        return rank / Node::conditional_select(outDegree, 1, outDegree > 0);
+    }
+
+    Message combine(const Message& a, const Message& b) const {
+        return a + b;
+    }
+
+    Value apply(const Value& rank, const Message& sum) const {
+        return (1.0 - damping) / vertexNumber + damping * sum;
+    }
+};
+
+/**
+ * Minimum label propagation: every vertex takes the smallest label among
+ * itself and its in-neighbours. On undirected edges it converges to the
+ * smallest vertex id of each connected component.
+ */
+struct LabelPropagationProgram {
+    typedef int Value;
+    typedef int Message;
+
+    int infinity;
+
+    Value initial(int v) const {
+        return v;
+    }
+
+    Message identity() const {
+        return infinity;
+    }
+
+    Message scatter(const Value& label, int outDegree, int weight) const {
+        return label;
+    }
+
+    Message combine(const Message& a, const Message& b) const {
+        return Node::conditional_select(a, b, Node::CTeq(Node::CTcmp(a, b), -1));
+    }
+
+    Value apply(const Value& label, const Message& best) const {
+        return combine(label, best);
+    }
+};
+
+/**
+ * BFS levels from source: an edge offers the level of its source plus one
+ * and every vertex keeps the smallest level it was offered.
+ */
+struct BFSLevelProgram {
+    typedef int Value;
+    typedef int Message;
+
+    int source;
+    int infinity;
+
+    Value initial(int v) const {
+        return Node::conditional_select(0, infinity, Node::CTeq(v, source));
+    }
+
+    Message identity() const {
+        return infinity;
+    }
+
+    Message scatter(const Value& level, int outDegree, int weight) const {
+        return Node::conditional_select(infinity, level + 1, Node::CTeq(level, infinity));
+    }
+
+    Message combine(const Message& a, const Message& b) const {
+        return Node::conditional_select(a, b, Node::CTeq(Node::CTcmp(a, b), -1));
+    }
+
+    Value apply(const Value& level, const Message& best) const {
+        return combine(level, best);
+    }
+};
+
+/**
+ * Bellman-Ford relaxation from source: an edge offers the distance of its
+ * source plus the edge weight and every vertex keeps the smallest distance
+ * it was offered. Unreached vertices stay at infinity.
+ */
+struct BellmanFordProgram {
+    typedef int Value;
+    typedef int Message;
+
+    int source;
+    int infinity;
+
+    Value initial(int v) const {
+        return Node::conditional_select(0, infinity, Node::CTeq(v, source));
+    }
+
+    Message identity() const {
+        return infinity;
+    }
+
+    Message scatter(const Value& dist, int outDegree, int weight) const {
+        return Node::conditional_select(infinity, dist + weight, Node::CTeq(dist, infinity));
+    }
+
+    Message combine(const Message& a, const Message& b) const {
+        return Node::conditional_select(a, b, Node::CTeq(Node::CTcmp(a, b), -1));
+    }
+
+    Value apply(const Value& dist, const Message& best) const {
+        return combine(dist, best);
+    }
+};
+
+#endif /* VERTEXPROGRAMS_H */
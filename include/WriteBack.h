@@ -0,0 +1,74 @@
+#ifndef WRITEBACK_H
+#define WRITEBACK_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/** Flushes a write-back queue holds before push waits for the worker */
+#define WRITE_BACK_QUEUE_SIZE 4
+/** Buckets per store ocall of a flush */
+#define WRITE_BACK_BATCH 10000
+
+/**
+ * Writes bucket flushes to an untrusted store on a worker thread, so an
+ * EvictBuckets returns once its buckets are serialised. Reads of the store
+ * go through read(), which takes every bucket still queued from the queue
+ * instead of the store (read-your-writes). Code that writes the store
+ * directly, replaces it or switches the store the ocalls reach has to
+ * drain() first. With a single hardware thread push() writes in line.
+ */
+class WriteBack {
+public:
+    using StoreWrite = void (*)(size_t blockCount, long long* indexes, const char* blk, size_t len);
+
+    WriteBack(StoreWrite write);
+    ~WriteBack();
+
+    /** Queues the buckets in data (blockSize bytes each) for indexes */
+    void push(vector<long long> indexes, vector<char> data, size_t blockSize);
+    /**
+     * Runs storeRead, a read of indexes into data, and overwrites the
+     * buckets that are still queued. Returns the bucket size storeRead
+     * returned.
+     */
+    size_t read(const vector<long long>& indexes, char* data, const function<size_t()>& storeRead);
+    /** Waits until every queued flush is in the store */
+    void drain();
+
+    /** Write-back of the ORAM store */
+    static WriteBack& RamStore();
+    /** Write-back of the heap store */
+    static WriteBack& HeapStore();
+
+private:
+    struct Flush {
+        vector<long long> indexes;
+        vector<char> data;
+        size_t blockSize;
+        /** position of each index in indexes */
+        unordered_map<long long, size_t> slots;
+    };
+
+    StoreWrite write;
+    /** guards queue and stop */
+    mutex queueMutex;
+    /** held by the worker for each store write and by read() for the store read */
+    mutex storeMutex;
+    condition_variable changed;
+    deque<Flush> queue;
+    bool stop = false;
+    /** not started if the machine has a single hardware thread */
+    thread worker;
+
+    void Write(vector<long long>& indexes, const vector<char>& data, size_t blockSize);
+    void Run();
+};
+
+#endif /* WRITEBACK_H */
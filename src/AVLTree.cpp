@@ -6,6 +6,7 @@
 #include <openssl/conf.h>
 #include <openssl/rand.h>
 #include "RAMStoreEnclaveInterface.h"
+#include "Log.h"
 
 void check_memory2(string text) {
     unsigned int required = 0x4f00000; // adapt to native uint
@@ -703,6 +704,7 @@ string AVLTree::search(Node* rootNode, Bid omapKey) {
         unsigned long long rnd = RandomPath();
         unsigned long long rnd2 = RandomPath();
         bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
+        oram->prefetchNextPath = oram->readCnt < upperBound;
         head = oram->ReadWrite(curKey, lastPos, newPos, isDummyAction, rnd2, omapKey);
 
         bool cond1 = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
@@ -743,7 +745,7 @@ string AVLTree::search(Node* rootNode, Bid omapKey) {
         res[i] = Node::conditional_select((byte_t)resVec[i], (byte_t)res[i], found);
     }
     // trim trailing spaces
-    res.erase(std::find_if(res.rbegin(), res.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), res.end());
+    res.erase(std::find_if(res.rbegin(), res.rend(), [](unsigned char c) { return !std::isspace(c); }).base(), res.end());
 
     return res;
 }
@@ -821,9 +823,9 @@ AVLTree::AVLTree(long long maxSize, Bid& rootKey, unsigned long long& rootPos, m
 
     bitonicSort(&nodes);
     double t;
-    printf("Creating BST of %d Nodes\n", (int)nodes.size());
+    LOG_INFO("Creating BST of %d Nodes\n", (int)nodes.size());
     sortedArrayToBST(&nodes, 0, nodes.size() - 2, rootPos, rootKey, permutation);
-    printf("Inserting in ORAM\n");
+    LOG_INFO("Inserting in ORAM\n");
 
     double gp;
     int size = (int) nodes.size();
@@ -960,15 +962,15 @@ AVLTree::AVLTree(long long maxSize, long long initialSize, Bid& rootKey, unsigne
     unsigned long long neededNumner = nextPower2 - initialSize;
     double h;
 
-    std::cout << "neededNumner: " << neededNumner << ", maxSize: " << maxSize << std::endl;
+    LOG_INFO("neededNumner: %lld, maxSize: %lld\n", (long long) neededNumner, (long long) maxSize);
 
     ocall_start_timer(426);
-    printf("Creating permutation\n");
-    createPermutation(maxSize);
+    LOG_INFO("Creating permutation\n");
+    createPermutation(maxOfRandom);
 
     h = ocall_stop_timer(426);
-    printf("PRF Time:%f\n", h);
-    printf("Adding dummy nodes to next power of 2\n");
+    LOG_INFO("PRF Time:%f\n", h);
+    LOG_INFO("Adding dummy nodes to next power of 2\n");
     ocall_start_timer(426);
 
 
@@ -1004,11 +1006,11 @@ AVLTree::AVLTree(long long maxSize, long long initialSize, Bid& rootKey, unsigne
     }
     totalNumberOfNodes = nextPower2;
 
-    printf("Bitonic sort\n");
+    LOG_INFO("Bitonic sort\n");
     bitonicSortOCallBased(nextPower2);
-    printf("Create AVL tree\n");
+    LOG_INFO("Create AVL tree\n");
     sortedArrayToBST(0, nextPower2 - 2, rootPos, rootKey);
-    printf("Finish AVL tree\n");
+    LOG_INFO("Finish AVL tree\n");
 
 
     Node* lastDummy = getNode(initialSize + neededNumner - 1);
@@ -1058,13 +1060,13 @@ AVLTree::AVLTree(long long maxSize, long long initialSize, Bid& rootKey, unsigne
     flushCache();
     flushPRFCache();
 
-    printf("Inserting in ORAM\n");
+    LOG_INFO("Inserting in ORAM\n");
 
     oram = new ORAM(maxSize, maxOfRandom * Z);
 
     double t;
     t = ocall_stop_timer(426);
-    printf("Setup Time:%f\n", t);
+    LOG_INFO("Setup Time:%f\n", t);
 }
 
 void AVLTree::bitonicSortOCallBased(int len) {
@@ -1363,7 +1365,7 @@ void AVLTree::createPermutation(int maxSize) {
             block buffer1(prf.id.begin(), prf.id.end());
             block prfVal = AES_PRF(secretkey, buffer1, PRF_SIZE * 2, PRF_SIZE);
             // std::cout << "prfVal.size(): " << prfVal.size() << ", prf.id.size(): " << prf.id.size() << std::endl;
-            std::copy(prfVal.begin(), prfVal.end(), prf.id.begin());
+            std::copy(prfVal.begin(), prfVal.begin() + prf.id.size(), prf.id.begin());
             counter++;
             k++;
             prf.index = pos;
@@ -1563,6 +1565,7 @@ void AVLTree::searchAndIncrement(Node* rootNode, Bid omapKey, string& res, bool
         unsigned long long rnd = RandomPath();
         unsigned long long rnd2 = RandomPath();
         bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
+        oram->prefetchNextPath = oram->readCnt < upperBound;
         head = oram->ReadWrite(curKey, lastPos, newPos, isDummyAction, rnd2, omapKey, isFirstPart);
 
         bool cond1 = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
@@ -1614,6 +1617,7 @@ void AVLTree::readAndSetDist(Node* rootNode, Bid omapKey, string& res, string ne
         unsigned long long rnd = RandomPath();
         unsigned long long rnd2 = RandomPath();
         bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
+        oram->prefetchNextPath = oram->readCnt < upperBound;
         head = oram->ReadWrite(curKey, lastPos, newPos, isDummyAction, rnd2, omapKey, newValue, false);
 
         bool cond1 = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
@@ -1669,6 +1673,7 @@ void AVLTree::searchInsert(Node* rootNode, Bid omapKey, string& res, string newV
         unsigned long long rnd2 = RandomPath();
         bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
 
+        oram->prefetchNextPath = oram->readCnt < upperBound;
         head = oram->ReadWrite(curKey, lastPos, newPos, isDummyAction, rnd2, omapKey, newVec);
 
         bool cond1 = Node::CTeq(Node::CTcmp(dummyState, 1), 0);
@@ -1702,6 +1707,98 @@ void AVLTree::searchInsert(Node* rootNode, Bid omapKey, string& res, string newV
 }
 
 
+/**
+ * Runs one search per key in lockstep: each step accesses the next node of
+ * every search, and the paths of one step are prefetched from the store
+ * with a single ocall. When newValues is given, the found values are
+ * updated as writeModes says (ValueWriteMode, WRITE_ALWAYS if NULL) and
+ * the values from before the update are returned.
+ * Searches that pass through the same node stay consistent, since each one
+ * reads the position that the previous search of the batch assigned to it
+ * and fetches it after that search moved the node there.
+ */
+vector<string> AVLTree::batchSearch(Node* rootNode, const vector<Bid>& keys, const vector<std::array<byte_t, 16> >* newValues, const vector<int>* writeModes) {
+    size_t count = keys.size();
+    vector<string> results(count);
+    if (count == 0) {
+        return results;
+    }
+    Bid dumyID = oram->nextDummyCounter;
+    vector<Bid> curKey(count, rootNode->key);
+    vector<unsigned long long> lastPos(count), newPos(count);
+    vector<int> dummyState(count, 0);
+    vector<bool> found(count, false);
+    vector<std::array<byte_t, 16> > resVec(count);
+    for (size_t i = 0; i < count; i++) {
+        lastPos[i] = i == 0 ? rootNode->pos : newPos[i - 1];
+        newPos[i] = RandomPath();
+    }
+    rootNode->pos = newPos[count - 1];
+    int upperBound = (int) (1.44 * oram->depth);
+
+    for (int step = 0; step <= upperBound; step++) {
+        vector<unsigned long long> leaves(count);
+        for (size_t i = 0; i < count; i++) {
+            bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState[i], 1), 0);
+            unsigned long long dummyLeaf = oram->planDummyLeaf();
+            leaves[i] = Node::conditional_select(dummyLeaf, lastPos[i], isDummyAction);
+        }
+        oram->prefetchPaths(leaves);
+
+        for (size_t i = 0; i < count; i++) {
+            unsigned long long rnd = RandomPath();
+            unsigned long long rnd2 = RandomPath();
+            bool isDummyAction = Node::CTeq(Node::CTcmp(dummyState[i], 1), 0);
+            Node* head;
+            if (newValues == NULL) {
+                head = oram->ReadWrite(curKey[i], lastPos[i], newPos[i], isDummyAction, rnd2, keys[i]);
+            } else {
+                int writeMode = writeModes == NULL ? WRITE_ALWAYS : (*writeModes)[i];
+                head = oram->ReadWrite(curKey[i], lastPos[i], newPos[i], isDummyAction, rnd2, keys[i], (*newValues)[i], writeMode);
+            }
+
+            bool cond1 = Node::CTeq(Node::CTcmp(dummyState[i], 1), 0);
+            bool cond2 = Node::CTeq(Bid::CTcmp(head->key, keys[i]), 1);
+            bool cond3 = Node::CTeq(Bid::CTcmp(head->key, keys[i]), -1);
+            bool cond4 = Node::CTeq(Bid::CTcmp(head->key, keys[i]), 0);
+            bool deadEnd = !cond1 && ((cond2 && head->leftID.isZero()) || (cond3 && head->rightID.isZero()));
+
+            lastPos[i] = Node::conditional_select(rnd, lastPos[i], cond1 || deadEnd);
+            lastPos[i] = Node::conditional_select(head->leftPos, lastPos[i], !cond1 && cond2);
+            lastPos[i] = Node::conditional_select(head->rightPos, lastPos[i], !cond1 && !cond2 && cond3);
+
+            Bid nextKey = dumyID;
+            for (int k = 0; k < nextKey.id.size(); k++) {
+                nextKey.id[k] = Node::conditional_select(head->leftID.id[k], nextKey.id[k], !cond1 && cond2 && !head->leftID.isZero());
+                nextKey.id[k] = Node::conditional_select(head->rightID.id[k], nextKey.id[k], !cond1 && !cond2 && cond3 && !head->rightID.isZero());
+            }
+            curKey[i] = nextKey;
+
+            newPos[i] = Node::conditional_select(rnd, newPos[i], cond1);
+            newPos[i] = Node::conditional_select(rnd2, newPos[i], !cond1 && cond2 && !head->leftID.isZero());
+            newPos[i] = Node::conditional_select(rnd2, newPos[i], !cond1 && !cond2 && cond3 && !head->rightID.isZero());
+
+            for (int k = 0; k < 16; k++) {
+                resVec[i][k] = Bid::conditional_select(head->value[k], resVec[i][k], !cond1);
+            }
+            found[i] = Node::conditional_select(true, found[i], !cond1 && !cond2 && !cond3 && cond4);
+            dummyState[i] = Node::conditional_select(dummyState[i] + 1, dummyState[i], (!cond1 && !cond2 && !cond3 && cond4) || deadEnd);
+            delete head;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        string res = "                ";
+        for (int k = 0; k < 16; k++) {
+            res[k] = Node::conditional_select((byte_t) resVec[i][k], (byte_t) res[k], found[i]);
+        }
+        res.erase(std::find(res.begin(), res.end(), '\0'), res.end());
+        res.erase(std::find_if(res.rbegin(), res.rend(), [](unsigned char c) { return !std::isspace(c); }).base(), res.end());
+        results[i] = res;
+    }
+    return results;
+}
+
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
 //-------------------------------------------------------------------------
@@ -1726,9 +1823,9 @@ void AVLTree::setupInsert(Bid& rootKey, unsigned long long& rootPos, map<Bid, st
     }
 
     double t;
-    printf("Creating BST of %d Nodes\n", (int)nodes.size());
+    LOG_INFO("Creating BST of %d Nodes\n", (int)nodes.size());
     sortedArrayToBST(&nodes, 0, nodes.size() - 1, rootPos, rootKey);
-    printf("Inserting in ORAM\n");
+    LOG_INFO("Inserting in ORAM\n");
 
     double gp;
     int size = (int) nodes.size();
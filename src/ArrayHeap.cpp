@@ -0,0 +1,117 @@
+#include "ArrayHeap.h"
+#include "RAMStoreEnclaveInterface.h"
+#include "Node.h"
+#include <cmath>
+
+ArrayHeap::ArrayHeap(int maxSize, int idCount) {
+    this->maxSize = maxSize;
+    this->idCount = idCount;
+    levels = (int) ceil(log2(maxSize + 1));
+    long long entrySlots = ObliviousArray::StoreSlots(maxSize);
+    ocall_setup_arrayStore(SCRATCH_ARRAY_STORE, entrySlots + ObliviousArray::StoreSlots(idCount), sizeof (ArrayBucket));
+    entries = new ObliviousArray(maxSize, 0);
+    slots = new ObliviousArray(idCount, entrySlots);
+}
+
+ArrayHeap::~ArrayHeap() {
+    delete entries;
+    delete slots;
+}
+
+void ArrayHeap::reset() {
+    entries->reset();
+    slots->reset();
+    size = 0;
+}
+
+std::array<byte_t, 16> ArrayHeap::pack(HeapEntry entry) {
+    std::array<byte_t, 16> value{};
+    std::memcpy(value.data(), &entry, sizeof (HeapEntry));
+    return value;
+}
+
+ArrayHeap::HeapEntry ArrayHeap::unpack(const std::array<byte_t, 16>& value) {
+    HeapEntry entry;
+    std::memcpy(&entry, value.data(), sizeof (HeapEntry));
+    return entry;
+}
+
+/** Slot entries hold slot + 1, so a zero (never written) entry means none */
+std::array<byte_t, 16> ArrayHeap::packSlot(int slot) {
+    std::array<byte_t, 16> value{};
+    int stored = slot + 1;
+    std::memcpy(value.data(), &stored, sizeof (int));
+    return value;
+}
+
+int ArrayHeap::unpackSlot(const std::array<byte_t, 16>& value) {
+    int stored;
+    std::memcpy(&stored, value.data(), sizeof (int));
+    return stored - 1;
+}
+
+ArrayHeap::HeapEntry ArrayHeap::select(HeapEntry a, HeapEntry b, int choice) {
+    return HeapEntry{Node::conditional_select(a.id, b.id, choice), Node::conditional_select(a.dist, b.dist, choice)};
+}
+
+void ArrayHeap::execute(int& id, int& dist, int op) {
+    bool extract = Node::CTeq(op, 1) && !Node::CTeq(size, 0);
+    bool emptyExtract = Node::CTeq(op, 1) && Node::CTeq(size, 0);
+    bool place = Node::CTeq(op, 2) || Node::CTeq(op, 4);
+
+    // the slot of id, the entry that moves into the hole (the last one for
+    // an extract, id's current entry for a decrease-key), and the root
+    int at = unpackSlot(slots->read(Node::conditional_select(id, 0, place)));
+    bool present = place && !Node::CTeq(at, -1);
+    int index = Node::conditional_select(size - 1, 0, extract);
+    index = Node::conditional_select(at, index, present);
+    HeapEntry current = unpack(entries->read(index));
+    HeapEntry root = unpack(entries->read(0));
+    slots->access(Node::conditional_select(root.id, 0, extract), std::array<byte_t, 16>{}, extract);
+
+    bool lower = present && Node::CTeq(Node::CTcmp(dist, current.dist), -1);
+    bool insert = place && !present && Node::CTeq(Node::CTcmp(size, maxSize), -1);
+    size = Node::conditional_select(size - 1, size, extract);
+    size = Node::conditional_select(size + 1, size, insert);
+
+    HeapEntry moving = select(current, HeapEntry{id, dist}, extract);
+    int hole = Node::conditional_select(size - 1, 0, insert);
+    hole = Node::conditional_select(at, hole, lower);
+    bool down = extract && Node::CTeq(Node::CTcmp(0, size), -1);
+    bool up = lower || insert;
+    bool fill = down || up;
+
+    // every step reads two entries (the children, or the parent) and moves
+    // one of them into the hole, or does the same accesses as dummies
+    for (int l = 0; l < levels; l++) {
+        int left = 2 * hole + 1;
+        int right = left + 1;
+        int parent = (hole - 1) / 2;
+        bool hasLeft = down && Node::CTeq(Node::CTcmp(left, size), -1);
+        bool hasRight = down && Node::CTeq(Node::CTcmp(right, size), -1);
+        bool hasParent = up && Node::CTeq(Node::CTcmp(0, hole), -1);
+        int first = Node::conditional_select(left, 0, hasLeft);
+        first = Node::conditional_select(parent, first, hasParent);
+        HeapEntry a = unpack(entries->read(first));
+        HeapEntry b = unpack(entries->read(Node::conditional_select(right, 0, hasRight)));
+
+        bool leftWins = !hasRight || !Node::CTeq(Node::CTcmp(b.dist, a.dist), -1);
+        HeapEntry child = select(a, b, leftWins);
+        int childIndex = Node::conditional_select(left, right, leftWins);
+        down = hasLeft && Node::CTeq(Node::CTcmp(child.dist, moving.dist), -1);
+        up = hasParent && Node::CTeq(Node::CTcmp(moving.dist, a.dist), -1);
+        bool move = down || up;
+        HeapEntry moved = select(child, a, down);
+        entries->access(hole, pack(moved), move);
+        slots->access(Node::conditional_select(moved.id, 0, move), packSlot(hole), move);
+        hole = Node::conditional_select(childIndex, hole, down);
+        hole = Node::conditional_select(parent, hole, up);
+    }
+    entries->access(hole, pack(moving), fill);
+    slots->access(Node::conditional_select(moving.id, 0, fill), packSlot(hole), fill);
+
+    id = Node::conditional_select(root.id, id, extract);
+    dist = Node::conditional_select(root.dist, dist, extract);
+    id = Node::conditional_select(-1, id, emptyExtract);
+    dist = Node::conditional_select(-1, dist, emptyExtract);
+}
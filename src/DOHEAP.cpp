@@ -7,20 +7,36 @@
 #include <cassert>
 #include <cstring>
 #include <map>
+#include <unordered_set>
 #include <stdexcept>
 #include "Common.h"
 #include "HeapObliviousOperations.h"
+#include "GraphObliviousOperations.h"
 #include "RAMStoreEnclaveInterface.h"
+#include "WriteBack.h"
+#include "Log.h"
 #include <algorithm>
 #include <stdlib.h>
 #include <vector>
 
-DOHEAP::DOHEAP(long long maxSize, bool simulation) : gen(rd()) {
+/**
+ * @param storeOffset first bucket of this heap in a heap store shared by
+ * several heaps (see StoreSlots), or -1 to set up a store of its own
+ * @param decreaseKeys keep a position map over the values 0..maxSize-1
+ * (the first 4 bytes of v, little-endian) so that each value has at most
+ * one entry and op 4 can lower its key (see execute). Keys then have to
+ * fit in 8 bytes.
+ * @param positionOffset first slot of the position map in a heap array
+ * store shared by several heaps (see PositionSlots), or -1 to set up a
+ * store of its own
+ */
+DOHEAP::DOHEAP(long long maxSize, bool simulation, long long storeOffset, bool decreaseKeys, long long positionOffset) : gen(rd()) {
+    WriteBack::HeapStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = std::uniform_int_distribution<long long>(0, maxOfRandom - 1);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n", depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n", depth);
     bucketCount = (long long) maxOfRandom * 2 - 1;
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
@@ -28,14 +44,19 @@ DOHEAP::DOHEAP(long long maxSize, bool simulation) : gen(rd()) {
 
     nextDummyCounter = INF;
     blockSize = sizeof (HeapNode); // B    
-    printf("block size:%d\n", (int)blockSize);
+    LOG_INFO("block size:%d\n", (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
-    storeBlockSize = (size_t)(Z + 1) * (size_t)(blockSize); 
-    plaintext_size = (size_t)(blockSize) * (size_t)(Z + 1);
+    storeBlockSize = sizeof (HeapBucket);
+    plaintext_size = sizeof (HeapBucket);
+    this->storeOffset = max(storeOffset, 0LL);
+    if (decreaseKeys) {
+        positionCount = (int) maxSize;
+        positionMap = new ObliviousArray(maxSize, positionOffset, HEAP_ARRAY_STORE);
+    }
     if (!simulation) {
         if (useLocalRamStore) {
             localStore = new LocalRAMStore(blockCount, storeBlockSize);
-        } else {
+        } else if (storeOffset < 0) {
             ocall_setup_heapStore(blockCount, storeBlockSize);
         }
     } else {
@@ -49,51 +70,109 @@ DOHEAP::DOHEAP(long long maxSize, bool simulation) : gen(rd()) {
     times.push_back(vector<double>());
     times.push_back(vector<double>());
 
-    printf("Initializing DOHEAP Buckets\n");
-    HeapBucket bucket;
-    for (int z = 0; z < Z; z++) {
-        bucket.blocks[z].id = 0;
-        bucket.blocks[z].data.resize(blockSize, 0);
-    }
-    bucket.subtree_min.id = 0;
-    bucket.subtree_min.data.resize(blockSize, 0);
+    LOG_INFO("Initializing DOHEAP Buckets\n");
     if (!simulation) {
-        //        InitializeBuckets(0, bucketCount, bucket);
-        long long i;
-        for (i = 0; i < maxOfRandom - 1; i++) {
-            if (i % 10000 == 0) {
-                printf("%d/%d\n", (int)i, (int)bucketCount);
-            }
-            HeapBucket bucket;
-            for (int z = 0; z < Z; z++) {
-                bucket.blocks[z].id = 0;
-                bucket.blocks[z].data.resize(blockSize, 0);
-            }
-            bucket.subtree_min.id = 0;
-            bucket.subtree_min.data.resize(blockSize, 0);
-            WriteBucket((int) i, bucket);
-        }
-        for (long long j = 0; i < bucketCount; i++, j++) {
-            if (i % 10000 == 0) {
-                printf("%d/%d\n", (int)i, (int)bucketCount);
-            }
-            HeapBucket bucket;
-
-            bucket.blocks[0].id = j;
-            HeapNode* tmp = new HeapNode();
-            tmp->index = 0;
-            tmp->pos = j;
-            bucket.blocks[0].data = convertNodeToBlock(tmp);
-            delete tmp;
-            for (int z = 1; z < Z; z++) {
-                bucket.blocks[z].id = 0;
-                bucket.blocks[z].data.resize(blockSize, 0);
-            }
-            bucket.subtree_min.id = 0;
-            bucket.subtree_min.data.resize(blockSize, 0);
-            WriteBucket((long long) i, bucket);
-        }
+        InitializeHeapBuckets();
+    }
+    InitializeStash();
+    LOG_INFO("End of Initialization\n");
+}
+
+/**
+ * Number of heap store slots (buckets) a heap of maxSize elements uses
+ */
+long long DOHEAP::StoreSlots(long long maxSize) {
+    int depth = (int) (ceil(log2(maxSize)) - 1) + 1;
+    return (long long) pow(2, depth) * 2 - 1;
+}
+
+/**
+ * Number of heap array store slots the position map of a heap of maxSize
+ * elements uses
+ */
+long long DOHEAP::PositionSlots(long long maxSize) {
+    return ObliviousArray::StoreSlots(maxSize);
+}
+
+/**
+ * Bucket indexes translated to the slots of this heap in the store
+ */
+vector<long long> DOHEAP::StoreIndexes(const vector<long long>& indexes) {
+    vector<long long> result(indexes);
+    for (long long& index : result) {
+        index += storeOffset;
+    }
+    return result;
+}
+
+DOHEAP::~DOHEAP() {
+    WriteBack::HeapStore().drain();
+    delete positionMap;
+    for (HeapNode* node : stash.nodes) {
+        delete node;
+    }
+}
+
+/**
+ * Writes an empty bucket to every slot of this heap with one ocall. Empty
+ * subtrees have an infinite minimum, as UpdateMin leaves them.
+ */
+void DOHEAP::InitializeHeapBuckets() {
+    HeapBucket bucket = HeapBucket();
+    bucket.subtree_min.key.setInfinity();
+    InitializeBuckets(0, bucketCount, bucket);
+    rootMinCached = false;
+}
+
+/**
+ * Empties the heap for the next query: drops cached buckets and stash
+ * content and rewrites the initial buckets in place, reusing the store.
+ */
+void DOHEAP::reset() {
+    virtualStorage.clear();
+    for (HeapNode* node : stash.nodes) {
+        delete node;
     }
+    stash.nodes.clear();
+    nextDummyCounter = INF;
+    if (positionMap != NULL) {
+        positionMap->reset();
+    }
+    InitializeHeapBuckets();
+    InitializeStash();
+}
+
+int DOHEAP::ValueIndex(const array<byte_t, 16>& v) {
+    int value;
+    std::memcpy(&value, v.data(), sizeof (int));
+    return value;
+}
+
+/**
+ * One position map access that hands the leaf (-1 if there is none) and
+ * key of the entry of value to update and stores what update leaves in
+ * them. A value outside 0..maxSize-1 has no entry and its update is
+ * dropped, with the same access.
+ */
+void DOHEAP::AccessPosition(int value, const function<void(long long&, Bid&)>& update) {
+    bool inRange = !HeapNode::CTeq(HeapNode::CTcmp(value, 0), -1) && HeapNode::CTeq(HeapNode::CTcmp(value, positionCount), -1);
+    long long index = HeapNode::conditional_select((long long) value, 0LL, inRange);
+    positionMap->access(index, [&](array<byte_t, 16>& entry) {
+        unsigned long long stored;
+        std::memcpy(&stored, entry.data(), sizeof (stored));
+        long long leaf = HeapNode::conditional_select((long long) stored - 1, -1LL, inRange);
+        Bid key;
+        std::memcpy(key.id.data(), entry.data() + sizeof (stored), sizeof (stored));
+        update(leaf, key);
+        stored = HeapNode::conditional_select((unsigned long long) (leaf + 1), stored, inRange);
+        std::memcpy(entry.data(), &stored, sizeof (stored));
+        for (int k = 0; k < (int) sizeof (stored); k++) {
+            entry[sizeof (stored) + k] = HeapNode::conditional_select(key.id[k], entry[sizeof (stored) + k], inRange);
+        }
+    });
+}
+
+void DOHEAP::InitializeStash() {
     for (auto i = 0; i < PERMANENT_STASH_SIZE; i++) {
         HeapNode* dummy = new HeapNode();
         dummy->index = nextDummyCounter;
@@ -102,17 +181,14 @@ DOHEAP::DOHEAP(long long maxSize, bool simulation) : gen(rd()) {
         stash.insert(dummy);
         nextDummyCounter++;
     }
-    printf("End of Initialization\n");
-}
-
-DOHEAP::~DOHEAP() {
 }
 
 // Fetches the array index a bucket that lise on a specific path
 
 void DOHEAP::WriteBucket(long long index, HeapBucket bucket) {
     block b = SerialiseBucket(bucket);
-    ocall_write_heapStore(index, (const char*) b.data(), (size_t) b.size());
+    WriteBack::HeapStore().drain();
+    ocall_write_heapStore(index + storeOffset, (const char*) b.data(), (size_t) b.size());
 }
 
 long long DOHEAP::GetNodeOnPath(long long leaf, int curDepth) {
@@ -126,64 +202,59 @@ long long DOHEAP::GetNodeOnPath(long long leaf, int curDepth) {
 
 // Write bucket to a single block
 
-block DOHEAP::SerialiseBucket(HeapBucket bucket) {
-    block buffer;
-    for (int z = 0; z < Z; z++) {
-        HeapBlock b = bucket.blocks[z];
-        buffer.insert(buffer.end(), b.data.begin(), b.data.end());
-    }
-    HeapBlock b = bucket.subtree_min;
-    buffer.insert(buffer.end(), b.data.begin(), b.data.end());
-    return buffer;
+block DOHEAP::SerialiseBucket(const HeapBucket& bucket) {
+    std::array<byte_t, sizeof (HeapBucket) > data = to_bytes(bucket);
+    return block(data.begin(), data.end());
 }
 
-HeapBucket DOHEAP::DeserialiseBucket(block buffer) {
+HeapBucket DOHEAP::DeserialiseBucket(const byte_t* buffer) {
     HeapBucket bucket;
+    std::memcpy((void*) &bucket, buffer, sizeof (HeapBucket));
+    return bucket;
+}
+
+/**
+ * Adds the Z slots of a bucket to the stash, empty slots as dummies
+ */
+void DOHEAP::StashBucket(const HeapBucket& bucket) {
     for (int z = 0; z < Z; z++) {
-        HeapBlock &curBlock = bucket.blocks[z];
-        curBlock.data.assign(buffer.begin(), buffer.begin() + blockSize);
-        HeapNode* node = convertBlockToNode(curBlock.data);
-        bool cond = HeapNode::CTeq(node->index, (unsigned long long) 0);
-        node->index = HeapNode::conditional_select((int)node->index, (int)nextDummyCounter, !cond);
-        for (int k = 0; k < node->value.size(); k++) {
-            node->value[k] = HeapNode::conditional_select(node->value[k], (byte_t)0, !cond);
-        }
-        for (int k = 0; k < node->key.id.size(); k++) {
-            node->key.id[k] = HeapNode::conditional_select(node->key.id[k], (byte_t)0, !cond);
-        }
-        node->isDummy = HeapNode::conditional_select(0, 1, !cond);
+        HeapNode* node = new HeapNode();
+        bool empty = HeapNode::CTeq(bucket.indexes[z], (unsigned long long) 0);
+        node->key = bucket.keys[z];
+        node->value = bucket.values[z];
+        node->pos = bucket.positions[z];
+        node->index = HeapNode::conditional_select(nextDummyCounter, bucket.indexes[z], empty);
+        node->evictionNode = -1;
+        node->isDummy = empty;
         stash.insert(node);
-        buffer.erase(buffer.begin(), buffer.begin() + blockSize);
     }
-    HeapBlock &curBlock = bucket.subtree_min;
-    curBlock.data.assign(buffer.begin(), buffer.begin() + blockSize);
-    return bucket;
 }
 
-vector<HeapBucket> DOHEAP::ReadBuckets(vector<long long> indexes) {
-    vector<HeapBucket> res;
-    if (indexes.size() == 0) {
-        return res;
-    }
-    if (useLocalRamStore) {
-        for (unsigned int i = 0; i < indexes.size(); i++) {
-            block buffer = localStore->Read(indexes[i]);
-            HeapBucket bucket = DeserialiseBucket(buffer);
-            res.push_back(bucket);
-        }
-    } else {
-        size_t readSize;
-        char* tmp = new char[indexes.size() * storeBlockSize];
-        readSize = ocall_nread_heapStore(indexes.size(), indexes.data(), tmp, indexes.size() * storeBlockSize);
-        for (unsigned int i = 0; i < indexes.size(); i++) {
-            block buffer(tmp + i*readSize, tmp + (i + 1) * readSize);
-            HeapBucket bucket = DeserialiseBucket(buffer);
-            res.push_back(bucket);
-            virtualStorage[indexes[i]] = bucket;
-        }
-        delete tmp;
-    }
-    return res;
+/**
+ * Stores node in slot z of bucket, or an empty slot if it is a dummy
+ */
+void DOHEAP::SetSlot(HeapBucket& bucket, int z, HeapNode* node) {
+    bool real = !node->isDummy;
+    bucket.keys[z] = Bid::conditional_select(node->key, Bid(), real);
+    for (int k = 0; k < (int) node->value.size(); k++) {
+        bucket.values[z][k] = HeapNode::conditional_select(node->value[k], (byte_t) 0, real);
+    }
+    bucket.positions[z] = HeapNode::conditional_select(node->pos, (unsigned long long) 0, real);
+    bucket.indexes[z] = HeapNode::conditional_select(node->index, (unsigned long long) 0, real);
+}
+
+/**
+ * Stash-style node of a subtree minimum, a dummy if the subtree is empty
+ */
+HeapNode* DOHEAP::MinNode(const HeapMin& min) {
+    HeapNode* node = new HeapNode();
+    node->key = min.key;
+    node->value = min.value;
+    node->pos = min.pos;
+    node->index = min.index;
+    node->evictionNode = -1;
+    node->isDummy = HeapNode::CTeq(min.index, (unsigned long long) 0);
+    return node;
 }
 
 void DOHEAP::InitializeBuckets(long long strtindex, long long endindex, HeapBucket bucket) {
@@ -193,7 +264,8 @@ void DOHEAP::InitializeBuckets(long long strtindex, long long endindex, HeapBuck
             localStore->Write(i, b);
         }
     } else {
-        ocall_initialize_heapStore(strtindex, endindex, (const char*) b.data(), (size_t) b.size());
+        WriteBack::HeapStore().drain();
+        ocall_initialize_heapStore(strtindex + storeOffset, endindex + storeOffset, (const char*) b.data(), (size_t) b.size());
     }
 }
 
@@ -207,168 +279,174 @@ void DOHEAP::WriteBuckets(vector<long long> indexes, vector<HeapBucket> buckets)
 }
 
 void DOHEAP::EvictBuckets() {
-    std::cout << "useLocalRamStore: " << useLocalRamStore << std::endl;
-    if (useLocalRamStore)
-    {
-        for (auto item : virtualStorage) {
-            block b = SerialiseBucket(item.second);
-            localStore->Write(item.first, b);
+    EvictBuckets(vector<DOHEAP*>(1, this));
+}
+
+/**
+ * Writes the cached buckets of all heaps back, those in the heap store
+ * with one flush, and empties their caches
+ */
+void DOHEAP::EvictBuckets(const vector<DOHEAP*>& heaps) {
+    vector<long long> indexes;
+    vector<char> data;
+    for (DOHEAP* heap : heaps) {
+        if (heap->virtualStorage.count(0) != 0) {
+            heap->rootMin = heap->virtualStorage[0].subtree_min;
+            heap->rootMinCached = true;
         }
-    }
-    else
-    {
-        unordered_map<long long, HeapBucket>::iterator it = virtualStorage.begin();
-        std::cout << "storeBlockSize: " << storeBlockSize << std::endl;
-        std::cout << "virtualStorage.size(): " << virtualStorage.size() << std::endl;
-        for (unsigned int j = 0; j <= virtualStorage.size() / 10000; j++)
-        {
-            std::cout << "j: " << j << std::endl;
-            char* tmp = new char[10000 * storeBlockSize];
-            vector<long long> indexes;
-            size_t cipherSize = 0;
-            std::cout << "i ub: " << min((int)(virtualStorage.size() - j * 10000), 10000) << std::endl;
-            for (int i = 0; i < min((int)(virtualStorage.size() - j * 10000), 10000); i++)
-            {
-                block b = SerialiseBucket(it->second);
-                indexes.push_back(it->first);
-                std::memcpy(tmp + i * b.size(), b.data(), b.size());
-                cipherSize = b.size();
-                it++;
+        if (heap->useLocalRamStore) {
+            for (auto item : heap->virtualStorage) {
+                block b = SerialiseBucket(item.second);
+                heap->localStore->Write(item.first, b);
             }
-            std::cout << "ocall_nwrite_heapStore" << std::endl;
-            if (min((int)(virtualStorage.size() - j * 10000), 10000) != 0)
-            {
-                ocall_nwrite_heapStore(min((int)(virtualStorage.size() - j * 10000), 10000),
-                                       indexes.data(), (const char *)tmp,
-                                       cipherSize * min((int)(virtualStorage.size() - j * 10000),
-                                                        10000));
+        } else {
+            LOG_TRACE("writing back %d buckets of %d bytes\n", (int) heap->virtualStorage.size(), heap->storeBlockSize);
+            for (const auto& item : heap->virtualStorage) {
+                block b = SerialiseBucket(item.second);
+                indexes.push_back(item.first + heap->storeOffset);
+                data.insert(data.end(), b.begin(), b.end());
             }
-            std::cout << "delete tmp" << std::endl;
-            delete tmp;
-            indexes.clear();
         }
+        heap->virtualStorage.clear();
     }
-    virtualStorage.clear();
+    WriteBack::HeapStore().push(std::move(indexes), std::move(data), sizeof (HeapBucket));
 }
 // Fetches blocks along a path, adding them to the stash
 
 void DOHEAP::FetchPath(long long leaf) {
     readCnt++;
     vector<long long> nodesIndex;
-    vector<long long> existingIndexes;
 
     long long node = leaf;
 
     node += bucketCount / 2;
-    if (virtualStorage.count(node) == 0) {
-        nodesIndex.push_back(node);
-    } else {
-        existingIndexes.push_back(node);
-    }
+    nodesIndex.push_back(node);
 
     for (int d = depth - 1; d >= 0; d--) {
         node = (node + 1) / 2 - 1;
-        if (virtualStorage.count(node) == 0) {
-            nodesIndex.push_back(node);
-        } else {
-            existingIndexes.push_back(node);
-        }
+        nodesIndex.push_back(node);
     }
 
-    ReadBuckets(nodesIndex);
+    LoadBuckets(nodesIndex);
 
-    for (unsigned int i = 0; i < existingIndexes.size(); i++) {
-        HeapBucket bucket = virtualStorage[existingIndexes[i]];
-        for (int z = 0; z < Z; z++) {
-            HeapBlock &curBlock = bucket.blocks[z];
-            HeapNode* node = convertBlockToNode(curBlock.data);
-            bool cond = HeapNode::CTeq(node->index, (unsigned long long) 0);
-            node->index = HeapNode::conditional_select(node->index, nextDummyCounter, !cond);
-            node->isDummy = HeapNode::conditional_select(0, 1, !cond);
-            stash.insert(node);
-        }
+    for (long long index : nodesIndex) {
+        StashBucket(virtualStorage[index]);
     }
 }
 
-void DOHEAP::UpdateMin() {
-    vector<long long> nodesIndex;
-
-    long long node = currentLeaf;
-    node += bucketCount / 2;
+/**
+ * Buckets of the path to leaf and their siblings, the buckets eviction
+ * and UpdateMin touch
+ */
+vector<long long> DOHEAP::PathBuckets(long long leaf) {
+    vector<long long> indexes;
+    long long node = leaf + bucketCount / 2;
     for (int d = depth - 1; d >= 0; d--) {
-        long long bucketID = node;
-        if (virtualStorage.count(bucketID) == 0) {
-            nodesIndex.push_back(bucketID);
-        }
-        if (bucketID % 2 == 0) {
-            bucketID--;
-        } else {
-            bucketID++;
-        }
-        if (virtualStorage.count(bucketID) == 0) {
-            nodesIndex.push_back(bucketID);
-        }
+        indexes.push_back(node);
+        indexes.push_back(node % 2 == 0 ? node - 1 : node + 1);
         node = (node + 1) / 2 - 1;
     }
+    indexes.push_back(0);
+    return indexes;
+}
 
-    if (virtualStorage.count(0) == 0) {
-        nodesIndex.push_back(0);
-    }
-    if (nodesIndex.size() > 0) {
-        size_t readSize;
-        char *tmp = new char[nodesIndex.size() * storeBlockSize];
-        readSize = ocall_nread_heapStore(nodesIndex.size(), nodesIndex.data(), tmp, nodesIndex.size() * storeBlockSize);
-        for (unsigned int i = 0; i < nodesIndex.size(); i++) {
-            block buffer(tmp + i*readSize, tmp + (i + 1) * readSize);
-            HeapBucket bucket;
-            for (int z = 0; z < Z; z++) {
-                HeapBlock &curBlock = bucket.blocks[z];
-                curBlock.data.assign(buffer.begin(), buffer.begin() + blockSize);
-                buffer.erase(buffer.begin(), buffer.begin() + blockSize);
+/**
+ * Caches the given buckets that are not cached yet, with one store read.
+ * Their blocks only enter the stash when FetchPath reaches them.
+ */
+void DOHEAP::LoadBuckets(const vector<long long>& indexes) {
+    LoadBuckets(vector<DOHEAP*>(1, this), vector<vector<long long> >(1, indexes));
+}
+
+/**
+ * LoadBuckets for several heaps at once, indexes[i] for heaps[i], with one
+ * read of the heap store
+ */
+void DOHEAP::LoadBuckets(const vector<DOHEAP*>& heaps, const vector<vector<long long> >& indexes) {
+    vector<long long> storeIndexes;
+    unordered_set<long long> requested;
+    vector<pair<DOHEAP*, long long> > targets;
+    for (unsigned int i = 0; i < heaps.size(); i++) {
+        DOHEAP* heap = heaps[i];
+        for (long long index : indexes[i]) {
+            long long storeIndex = index + heap->storeOffset;
+            if (heap->virtualStorage.count(index) != 0 || !requested.insert(storeIndex).second) {
+                continue;
+            }
+            if (heap->useLocalRamStore) {
+                block buffer = heap->localStore->Read(index);
+                heap->virtualStorage[index] = DeserialiseBucket(buffer.data());
+                continue;
             }
-            HeapBlock &curBlock = bucket.subtree_min;
-            curBlock.data.assign(buffer.begin(), buffer.begin() + blockSize);
-            virtualStorage[nodesIndex[i]] = bucket;
+            storeIndexes.push_back(storeIndex);
+            targets.push_back(make_pair(heap, index));
         }
-        delete tmp;
     }
+    if (storeIndexes.size() == 0) {
+        return;
+    }
+    char *tmp = new char[storeIndexes.size() * sizeof (HeapBucket)];
+    size_t readSize = WriteBack::HeapStore().read(storeIndexes, tmp, [&]() {
+        return ocall_nread_heapStore(storeIndexes.size(), storeIndexes.data(), tmp, storeIndexes.size() * sizeof (HeapBucket));
+    });
+    for (unsigned int i = 0; i < targets.size(); i++) {
+        targets[i].first->virtualStorage[targets[i].second] = DeserialiseBucket((const byte_t*) tmp + i * readSize);
+    }
+    delete[] tmp;
+}
+
+/**
+ * subtree_min of the root bucket. The root is on every evicted path, so
+ * EvictBuckets keeps its latest value and the store is only read for it
+ * right after the buckets are initialized.
+ */
+HeapMin DOHEAP::RootMin() {
+    if (virtualStorage.count(0) == 0 && !rootMinCached) {
+        LoadBuckets(vector<long long>(1, 0));
+    }
+    if (virtualStorage.count(0) != 0) {
+        return virtualStorage[0].subtree_min;
+    }
+    return rootMin;
+}
+
+/**
+ * Smallest entry among the Z slots of a bucket, an empty HeapMin with an
+ * infinite key if all slots are empty
+ */
+HeapMin DOHEAP::SlotsMin(const HeapBucket& bucket) {
+    HeapMin localMin = HeapMin();
+    localMin.key.setInfinity();
+    for (int i = 0; i < Z; i++) {
+        bool cond = Bid::CTeq(-1, Bid::CTcmp(bucket.keys[i], localMin.key)) && !HeapNode::CTeq(bucket.indexes[i], (unsigned long long) 0);
+        localMin.key = Bid::conditional_select(bucket.keys[i], localMin.key, cond);
+        for (int k = 0; k < (int) localMin.value.size(); k++) {
+            localMin.value[k] = HeapNode::conditional_select(bucket.values[i][k], localMin.value[k], cond);
+        }
+        localMin.pos = HeapNode::conditional_select(bucket.positions[i], localMin.pos, cond);
+        localMin.index = HeapNode::conditional_select(bucket.indexes[i], localMin.index, cond);
+    }
+    return localMin;
+}
+
+/**
+ * Recomputes subtree_min bottom-up along currentLeaf. Each bucket is a
+ * branch-free min-reduction over the Z header keys and the minima of its
+ * two children.
+ */
+void DOHEAP::UpdateMin() {
+    LoadBuckets(PathBuckets(currentLeaf));
 
-    node = currentLeaf;
+    long long node = currentLeaf;
     node += bucketCount / 2;
     for (int d = depth; d >= 0; d--) {
         HeapBucket& curBucket = virtualStorage[node];
-        HeapNode localMin;
-        unsigned long long localID = 0;
-        localMin.key.setInfinity();
-        localMin.isDummy = true;
-        for (int i = 0; i < Z; i++) {
-            HeapNode* node = convertBlockToNode(curBucket.blocks[i].data);
-            bool cond = Bid::CTeq(1, Bid::CTcmp(localMin.key, node->key)) && !node->isDummy;
-            HeapNode::conditional_assign(&localMin, node, cond);
-            localID = HeapNode::conditional_select(localID, curBucket.blocks[i].id, cond);
-            delete node;
-        }
+        HeapMin localMin = SlotsMin(curBucket);
         if (d != depth) {
-            HeapBucket leftBucket = virtualStorage[((node + 1)*2) - 1];
-            HeapNode* leftnode = convertBlockToNode(leftBucket.subtree_min.data);
-            bool cond = Bid::CTeq(1, Bid::CTcmp(localMin.key, leftnode->key)) && !leftnode->isDummy;
-            HeapNode::conditional_assign(&localMin, leftnode, cond);
-            localID = HeapNode::conditional_select(localID, leftBucket.subtree_min.id, cond);
-            delete leftnode;
-
-            HeapBucket rightBucket = virtualStorage[((node + 1)*2)];
-            HeapNode* rightnode = convertBlockToNode(rightBucket.subtree_min.data);
-            cond = Bid::CTeq(1, Bid::CTcmp(localMin.key, rightnode->key)) && !rightnode->isDummy;
-            HeapNode::conditional_assign(&localMin, rightnode, cond);
-            localID = HeapNode::conditional_select(localID, rightBucket.subtree_min.id, cond);
-            delete rightnode;
-        }
-
-        curBucket.subtree_min.id = localID;
-        block tmp = convertNodeToBlock(&localMin);
-        for (int k = 0; k < tmp.size(); k++) {
-            curBucket.subtree_min.data[k] = HeapNode::conditional_select(curBucket.subtree_min.data[k], tmp[k], localMin.isDummy);
+            localMin.reduce(virtualStorage[((node + 1)*2) - 1].subtree_min);
+            localMin.reduce(virtualStorage[((node + 1)*2)].subtree_min);
         }
+        curBucket.subtree_min = localMin;
 
         node = (node + 1) / 2 - 1;
     }
@@ -377,23 +455,7 @@ void DOHEAP::UpdateMin() {
 pair<Bid,array<byte_t, 16> > DOHEAP::extractMin() {
     pair<Bid,array<byte_t, 16> > res;
     array<byte_t, 16> result;
-    HeapBlock curBlock;
-    if (virtualStorage.count(0) == 0) {
-        vector<long long> nodesIndex;
-        nodesIndex.push_back(0);
-        size_t readSize;
-        char *tmp = new char[nodesIndex.size() * storeBlockSize];
-        readSize = ocall_nread_heapStore(nodesIndex.size(), nodesIndex.data(), tmp, nodesIndex.size() * storeBlockSize);
-        block ciphertext(tmp, tmp + readSize);
-        block buffer(tmp, tmp + readSize);
-        curBlock.data.assign(buffer.begin() + blockSize*Z, buffer.begin() + blockSize * (Z + 1));
-        delete tmp;
-    } else {
-        curBlock.data.assign(virtualStorage[0].subtree_min.data.begin(), virtualStorage[0].subtree_min.data.end());
-    }
-    HeapNode* rootnode = convertBlockToNode(curBlock.data);
-    HeapNode* minnode = new HeapNode();
-    HeapNode::conditional_assign(minnode,rootnode,true);
+    HeapNode* minnode = MinNode(RootMin());
     bool isInStash=false;
     
     for (HeapNode* node : stash.nodes) {
@@ -408,6 +470,7 @@ pair<Bid,array<byte_t, 16> > DOHEAP::extractMin() {
     res.second = result;
     res.first = minnode->key;
     
+    LoadBuckets(PathBuckets(minnode->pos));
     FetchPath(minnode->pos);
     for (HeapNode* node : stash.nodes) {
         bool choice = HeapNode::CTeq(0, Bid::CTcmp(node->key, minnode->key)) && HeapNode::CTeq(0, Bid::CTcmp(node->value, minnode->value));
@@ -416,7 +479,6 @@ pair<Bid,array<byte_t, 16> > DOHEAP::extractMin() {
     }
     currentLeaf = minnode->pos;
     delete minnode;
-    delete rootnode;
     evict(true);
     EvictBuckets();
     return res;
@@ -424,20 +486,7 @@ pair<Bid,array<byte_t, 16> > DOHEAP::extractMin() {
 
 array<byte_t, 16> DOHEAP::findMin() {
     array<byte_t, 16> result;
-    HeapBlock curBlock;
-    if (virtualStorage.count(0) == 0) {
-        vector<long long> nodesIndex;
-        nodesIndex.push_back(0);
-        size_t readSize;
-        char *tmp = new char[nodesIndex.size() * storeBlockSize];
-        readSize = ocall_nread_heapStore(nodesIndex.size(), nodesIndex.data(), tmp, nodesIndex.size() * storeBlockSize);
-        block buffer(tmp, tmp + readSize);
-        curBlock.data.assign(buffer.begin() + blockSize*Z, buffer.begin() + blockSize * (Z + 1));
-        delete tmp;
-    } else {
-        curBlock.data.assign(virtualStorage[0].subtree_min.data.begin(), virtualStorage[0].subtree_min.data.end());
-    }
-    HeapNode* minnode = convertBlockToNode(curBlock.data);
+    HeapNode* minnode = MinNode(RootMin());
     for (int k = 0; k < minnode->value.size(); k++) {
         result[k] = minnode->value[k];
     }
@@ -451,124 +500,373 @@ array<byte_t, 16> DOHEAP::findMin() {
  * @param v v[0] is least significant byte and v[16] is the most significant byte
  */
 void DOHEAP::insert(Bid k, array<byte_t, 16> v) {
-    HeapNode* node = new HeapNode();
-    node->pos = RandomPath();
-    node->key = k;
-    node->value = v;
-    node->index = 1;
-    node->isDummy = false;
-    stash.insert(node);
-    currentLeaf = RandomPath() / 2;
-    FetchPath(currentLeaf);
-    evict(true);
-    currentLeaf = RandomPath() / 2 + (maxOfRandom / 2);
-    FetchPath(currentLeaf);
-    evict(true);
-    EvictBuckets();
+    execute(k, v, 2);
 }
 
 void DOHEAP::dummy() {
-    currentLeaf = RandomPath() / 2;
-    FetchPath(currentLeaf);
-    evict(true);
-    currentLeaf = RandomPath() / 2 + (maxOfRandom / 2);
-    FetchPath(currentLeaf);
-    evict(true);
-    EvictBuckets();
+    array<byte_t, 16> v;
+    v.fill(0);
+    execute(Bid(), v, 3);
+}
+
+/**
+ * Lowers the key of v, or inserts v if the heap holds no entry for it.
+ * Needs a heap set up with decreaseKeys; the access pattern is the one of
+ * every other execute operation.
+ */
+void DOHEAP::decreaseKey(Bid k, array<byte_t, 16> v) {
+    execute(k, v, 4);
 }
 
 /**
- * @param OP:1 extract-min  2:insert    3: dummy
+ * Replaces the content of the heap with items in one pass instead of one
+ * insert (two path fetches and evictions) per item. Every item gets an
+ * independent random leaf, as an insert would give it. The tree is then
+ * packed level by level from the leaves up: the items still unplaced and Z
+ * padding slots per bucket of the level are sorted obliviously by bucket,
+ * each bucket keeps its first Z records and the overflow moves on to the
+ * parents. Items left over at the root go to the stash. subtree_min is
+ * computed on the way up. With a position map the values of items must be
+ * distinct.
+ */
+void DOHEAP::buildHeap(const vector<pair<Bid, array<byte_t, 16> > >& items) {
+    struct BuildRecord {
+        unsigned long long order;
+        unsigned long long pos;
+        /** 1 for an item, 0 for padding */
+        unsigned long long index;
+        std::array<byte_t, ID_SIZE> key;
+        std::array<byte_t, 16> value;
+    };
+    long long slotCount = maxOfRandom * Z;
+    if ((long long) items.size() > slotCount) {
+        throw runtime_error("heap holds at most " + to_string(slotCount) + " entries");
+    }
+    virtualStorage.clear();
+    for (HeapNode* node : stash.nodes) {
+        delete node;
+    }
+    stash.nodes.clear();
+    nextDummyCounter = INF;
+
+    unsigned long long itemCount = items.size();
+    vector<BuildRecord> pending;
+    vector<long long> leaves;
+    for (const auto& item : items) {
+        BuildRecord r = BuildRecord();
+        r.pos = RandomPath();
+        r.index = 1;
+        r.key = item.first.id;
+        r.value = item.second;
+        pending.push_back(r);
+        leaves.push_back(r.pos);
+    }
+    auto byOrder = [](const BuildRecord & r) {
+        return r.order;
+    };
+
+    vector<HeapMin> childMins;
+    vector<long long> indexes;
+    vector<HeapBucket> buckets;
+    for (int d = depth; d >= 0; d--) {
+        unsigned long long count = 1ULL << d;
+        long long first = (long long) count - 1;
+        // bucket of the level first, items before padding; padding that
+        // moved up from the level below goes last
+        vector<BuildRecord> records = pending;
+        for (BuildRecord& r : records) {
+            bool real = !HeapNode::CTeq(r.index, 0ULL);
+            r.order = HeapNode::conditional_select((r.pos >> (depth - d)) * 2, count * 2, real);
+        }
+        for (unsigned long long b = 0; b < count; b++) {
+            for (int z = 0; z < Z; z++) {
+                BuildRecord slot = BuildRecord();
+                slot.order = b * 2 + 1;
+                records.push_back(slot);
+            }
+        }
+        GraphObliviousOperations::bitonicSort(&records, byOrder);
+
+        // the first Z records of each bucket stay, in bucket order; the
+        // rest is sorted behind them, overflowing items first
+        unsigned long long previous = count;
+        int rank = 0;
+        for (BuildRecord& r : records) {
+            unsigned long long bucket = r.order / 2;
+            rank = HeapNode::conditional_select(rank + 1, 0, HeapNode::CTeq(bucket, previous));
+            previous = bucket;
+            bool kept = HeapNode::CTeq(HeapNode::CTcmp(rank, Z), -1) && !HeapNode::CTeq(bucket, count);
+            r.order = HeapNode::conditional_select(bucket, count + HeapNode::CTeq(r.index, 0ULL), kept);
+        }
+        GraphObliviousOperations::bitonicSort(&records, byOrder);
+
+        vector<HeapMin> mins(count);
+        for (unsigned long long b = 0; b < count; b++) {
+            HeapBucket bucket = HeapBucket();
+            for (int z = 0; z < Z; z++) {
+                const BuildRecord& r = records[b * Z + z];
+                bucket.keys[z] = Bid(r.key);
+                bucket.values[z] = r.value;
+                bucket.positions[z] = r.pos;
+                bucket.indexes[z] = r.index;
+            }
+            bucket.subtree_min = SlotsMin(bucket);
+            if (d != depth) {
+                bucket.subtree_min.reduce(childMins[2 * b]);
+                bucket.subtree_min.reduce(childMins[2 * b + 1]);
+            }
+            mins[b] = bucket.subtree_min;
+            indexes.push_back(first + (long long) b);
+            buckets.push_back(bucket);
+            if (indexes.size() == 10000) {
+                StoreBuckets(indexes, buckets);
+            }
+        }
+        childMins = mins;
+        pending.assign(records.begin() + count * Z, records.end());
+    }
+    StoreBuckets(indexes, buckets);
+    rootMin = childMins[0];
+    rootMinCached = true;
+
+    // what the root could not take fills the stash, items first
+    for (unsigned long long i = 0; i < PERMANENT_STASH_SIZE; i++) {
+        HeapNode* node = new HeapNode();
+        bool real = i < itemCount && !HeapNode::CTeq(pending[i].index, 0ULL);
+        node->isDummy = !real;
+        node->evictionNode = -1;
+        node->index = HeapNode::conditional_select(1ULL, nextDummyCounter, real);
+        nextDummyCounter++;
+        if (i < itemCount) {
+            node->key = Bid(pending[i].key);
+            node->value = pending[i].value;
+            node->pos = pending[i].pos;
+        } else {
+            node->value.fill(0);
+            node->pos = 0;
+        }
+        stash.insert(node);
+    }
+    if (itemCount > PERMANENT_STASH_SIZE && !HeapNode::CTeq(pending[PERMANENT_STASH_SIZE].index, 0ULL)) {
+        throw runtime_error("heap stash overflow in buildHeap");
+    }
+
+    if (positionMap != NULL) {
+        BuildPositions(items, leaves);
+    }
+}
+
+/**
+ * Writes buckets to the store with one ocall and empties both vectors
+ */
+void DOHEAP::StoreBuckets(vector<long long>& indexes, vector<HeapBucket>& buckets) {
+    WriteBack::HeapStore().drain();
+    if (indexes.size() > 0) {
+        char* tmp = new char[indexes.size() * storeBlockSize];
+        for (unsigned int i = 0; i < indexes.size(); i++) {
+            std::memcpy(tmp + i * storeBlockSize, (const void*) &buckets[i], storeBlockSize);
+        }
+        ocall_nwrite_heapStore(indexes.size(), StoreIndexes(indexes).data(), (const char*) tmp, indexes.size() * storeBlockSize);
+        delete[] tmp;
+    }
+    indexes.clear();
+    buckets.clear();
+}
+
+/**
+ * Position map of buildHeap without an access per item: the entries of the
+ * items and one slot record per value are sorted by value (entry right
+ * before its slot), a scan copies each entry into the slot after it, a
+ * second sort puts the slots back in value order, and the map is loaded
+ * with every value's slot.
+ */
+void DOHEAP::BuildPositions(const vector<pair<Bid, array<byte_t, 16> > >& items, const vector<long long>& leaves) {
+    struct PositionRecord {
+        unsigned long long order;
+        long long leaf;
+        std::array<byte_t, ID_SIZE> key;
+    };
+    unsigned long long valueCount = positionCount;
+    vector<PositionRecord> records;
+    records.reserve(items.size() + valueCount);
+    for (unsigned int i = 0; i < items.size(); i++) {
+        unsigned long long value = (unsigned int) ValueIndex(items[i].second);
+        records.push_back(PositionRecord{value * 2, leaves[i], items[i].first.id});
+    }
+    for (unsigned long long v = 0; v < valueCount; v++) {
+        PositionRecord slot = PositionRecord();
+        slot.order = v * 2 + 1;
+        slot.leaf = -1;
+        records.push_back(slot);
+    }
+    auto byOrder = [](const PositionRecord & r) {
+        return r.order;
+    };
+    GraphObliviousOperations::bitonicSort(&records, byOrder);
+
+    PositionRecord entry = PositionRecord();
+    entry.leaf = -1;
+    for (PositionRecord& r : records) {
+        bool isSlot = HeapNode::CTeq(r.order & 1, 1ULL);
+        bool match = isSlot && HeapNode::CTeq(r.order, entry.order + 1);
+        r.leaf = HeapNode::conditional_select(entry.leaf, r.leaf, match);
+        r.key = GraphObliviousOperations::conditional_select(entry.key, r.key, match);
+        entry = GraphObliviousOperations::conditional_select(r, entry, !isSlot);
+        // slots first, in value order
+        r.order = HeapNode::conditional_select(r.order / 2, valueCount + r.order, isSlot);
+    }
+    GraphObliviousOperations::bitonicSort(&records, byOrder);
+
+    vector<array<byte_t, 16> > entries(valueCount);
+    for (unsigned long long v = 0; v < valueCount; v++) {
+        unsigned long long stored = records[v].leaf + 1;
+        std::memcpy(entries[v].data(), &stored, sizeof (stored));
+        std::memcpy(entries[v].data() + sizeof (stored), records[v].key.data(), sizeof (stored));
+    }
+    positionMap->load(entries);
+}
+
+/**
+ * @param OP:1 extract-min  2:insert    3: dummy    4: decrease-key
+ * (insert if v has no entry; without a position map it is an insert).
+ * With a position map, insert expects v to have no entry yet.
  * @return 
  */
 pair<Bid,array<byte_t, 16> > DOHEAP::execute(Bid k, array<byte_t, 16> v, int op) {
-    pair<Bid,array<byte_t, 16> > res;
-    HeapNode* node = new HeapNode();
-    node->pos = RandomPath();
-    std::cout << "Random Path: " << node->pos << std::endl;
+    LoadBuckets(BeginExecute(k, v, op));
+    pair<Bid,array<byte_t, 16> > res = FinishExecute();
+    EvictBuckets();
+    return res;
+}
+
+/**
+ * execute on several heaps of one heap store, operation i on heaps[i]. The
+ * buckets of all operations are read with one store ocall and written back
+ * with one flush; otherwise each heap makes the accesses of its execute.
+ * Heaps must be distinct.
+ */
+vector<pair<Bid,array<byte_t, 16> > > DOHEAP::executeBatch(const vector<DOHEAP*>& heaps, const vector<Bid>& keys, const vector<array<byte_t, 16> >& values, const vector<int>& ops) {
+    vector<vector<long long> > indexes;
+    for (unsigned int i = 0; i < heaps.size(); i++) {
+        indexes.push_back(heaps[i]->BeginExecute(keys[i], values[i], ops[i]));
+    }
+    LoadBuckets(heaps, indexes);
+    vector<pair<Bid,array<byte_t, 16> > > results;
+    for (DOHEAP* heap : heaps) {
+        results.push_back(heap->FinishExecute());
+    }
+    EvictBuckets(heaps);
+    return results;
+}
+
+/**
+ * First half of execute, up to the bucket read: updates the position map,
+ * adds the new entry to the stash and finds the minimum
+ * @return buckets of both evicted paths and the siblings UpdateMin needs
+ */
+vector<long long> DOHEAP::BeginExecute(Bid k, array<byte_t, 16> v, int op) {
+    HeapOperation& pending = this->pending;
     Bid dummyKey;
     dummyKey.setInfinity();
     bool isInsert = HeapNode::CTeq(op, 2);
     bool isExtract = HeapNode::CTeq(op, 1);
-    node->key = Bid::conditional_select(k, dummyKey, isInsert);
+    bool isDecrease = HeapNode::CTeq(op, 4);
+    long long newLeaf = RandomPath();
+    LOG_TRACE("Random Path: %lld\n", newLeaf);
+    long long oldLeaf = -1;
+    bool addNode = isInsert || isDecrease;
+    bool moveNode = false;
+    if (positionMap != NULL) {
+        // the entry of v is looked up and moved to newLeaf in one access
+        AccessPosition(ValueIndex(v), [&](long long& leaf, Bid& key) {
+            oldLeaf = leaf;
+            bool present = !HeapNode::CTeq(leaf, -1LL);
+            addNode = isInsert || (isDecrease && !present);
+            moveNode = isDecrease && present && HeapNode::CTeq(Bid::CTcmp(k, key), -1);
+            leaf = HeapNode::conditional_select(newLeaf, leaf, addNode || moveNode);
+            key = Bid::conditional_select(k, key, addNode || moveNode);
+        });
+    }
+    bool present = !HeapNode::CTeq(oldLeaf, -1LL);
+
+    HeapNode* node = new HeapNode();
+    node->pos = newLeaf;
+    node->key = Bid::conditional_select(k, dummyKey, addNode);
     node->value = v;
-    node->index = HeapNode::conditional_select(1, 0, isInsert);
-    node->isDummy = !isInsert;
+    node->index = HeapNode::conditional_select(1, 0, addNode);
+    node->isDummy = !addNode;
     stash.insert(node);
 
     array<byte_t, 16> result;
-    HeapBlock curBlock;
-    std::cout << "virtualStorage.count(0): " << virtualStorage.count(0) << std::endl;
-    if (virtualStorage.count(0) == 0) {
-        vector<long long> nodesIndex;
-        nodesIndex.push_back(0);
-        size_t readSize;
-        char *tmp = new char[nodesIndex.size() * storeBlockSize];
-        readSize = ocall_nread_heapStore(nodesIndex.size(), nodesIndex.data(), tmp, nodesIndex.size() * storeBlockSize);
-        block buffer(tmp, tmp + readSize);
-        curBlock.data.assign(buffer.begin() + blockSize*Z, buffer.begin() + blockSize * (Z + 1));
-        delete tmp;
-    } else {
-        curBlock.data.assign(virtualStorage[0].subtree_min.data.begin(), virtualStorage[0].subtree_min.data.end());
-    }
-    std::cout << "curBlock.data.size(): " << curBlock.data.size() << std::endl;
-    HeapNode* rootnode = convertBlockToNode(curBlock.data);
-    HeapNode* minnode = new HeapNode();
-    HeapNode::conditional_assign(minnode,rootnode,true);
+    HeapNode* minnode = MinNode(RootMin());
     bool isInStash = false;
-    std::cout << "stash.nodes.size(): " << stash.nodes.size() << std::endl;
+    LOG_TRACE("stash.nodes.size(): %d\n", (int) stash.nodes.size());
     for (HeapNode *node : stash.nodes)
     {
         isInStash = HeapNode::CTeq(-1, Bid::CTcmp(node->key, minnode->key)) & isExtract & !node->isDummy;
         HeapNode::conditional_assign(minnode, node, isInStash);
     }
-    std::cout << "minnode->value.size(): " << minnode->value.size() << std::endl;
     for (int k = 0; k < minnode->value.size(); k++) {
         result[k] = minnode->value[k];
     }
-    res.second = result;
-    res.first = minnode->key;
+    pending.result.second = result;
+    pending.result.first = minnode->key;
 
+    // extract-min reads the path of the minimum and decrease-key the path
+    // of the current entry of v; the other operations read a random path
     currentLeaf = RandomPath() / 2;
-    std::cout << "Current Leaf: " << currentLeaf << std::endl;
     currentLeaf = HeapNode::conditional_select(minnode->pos, (unsigned long long)currentLeaf, isExtract);
-    std::cout << "Current Leaf: " << currentLeaf << std::endl;
+    currentLeaf = HeapNode::conditional_select(oldLeaf, currentLeaf, isDecrease && present);
+    LOG_TRACE("Current Leaf: %lld\n", currentLeaf);
+    pending.secondLeaf = RandomPath() / 2 + (maxOfRandom / 2);
+    pending.minnode = minnode;
+    pending.key = k;
+    pending.value = v;
+    pending.isExtract = isExtract;
+    pending.moveNode = moveNode;
+    pending.newLeaf = newLeaf;
+
+    vector<long long> indexes = PathBuckets(currentLeaf);
+    vector<long long> secondIndexes = PathBuckets(pending.secondLeaf);
+    indexes.insert(indexes.end(), secondIndexes.begin(), secondIndexes.end());
+    return indexes;
+}
 
+/**
+ * Second half of execute, once the buckets of BeginExecute are cached:
+ * removes or moves the entry and evicts both paths into the cache
+ */
+pair<Bid,array<byte_t, 16> > DOHEAP::FinishExecute() {
+    HeapOperation& pending = this->pending;
+    HeapNode* minnode = pending.minnode;
     FetchPath(currentLeaf);
-    std::cout << "stash.nodes.size(): " << stash.nodes.size() << std::endl;
+    LOG_TRACE("stash.nodes.size(): %d\n", (int) stash.nodes.size());
     for (HeapNode *node : stash.nodes)
     {
-        bool choice = HeapNode::CTeq(0, Bid::CTcmp(node->key, minnode->key)) & isExtract & HeapNode::CTeq(0, Bid::CTcmp(node->value, minnode->value));
+        bool choice = HeapNode::CTeq(0, Bid::CTcmp(node->key, minnode->key)) & pending.isExtract & HeapNode::CTeq(0, Bid::CTcmp(node->value, minnode->value));
         node->isDummy = HeapNode::conditional_select(true, node->isDummy, choice);
         node->index = HeapNode::conditional_select((unsigned long long) 0, node->index, choice);
+        bool moved = pending.moveNode && !node->isDummy && HeapNode::CTeq(0, Bid::CTcmp(node->value, pending.value));
+        node->key = Bid::conditional_select(pending.key, node->key, moved);
+        node->pos = HeapNode::conditional_select((unsigned long long) pending.newLeaf, node->pos, moved);
+    }
+    if (positionMap != NULL) {
+        bool found = pending.isExtract && !HeapNode::CTeq(minnode->index, (unsigned long long) 0);
+        AccessPosition(ValueIndex(minnode->value), [&](long long& leaf, Bid& key) {
+            leaf = HeapNode::conditional_select(-1LL, leaf, found);
+        });
     }
     evict(true);
-    currentLeaf = RandomPath() / 2 + (maxOfRandom / 2);
-    std::cout << "currentLeaf: " << currentLeaf << std::endl;
+    currentLeaf = pending.secondLeaf;
+    LOG_TRACE("Second Leaf: %lld\n", currentLeaf);
     FetchPath(currentLeaf);
     evict(true);
-    std::cout << "Evicting Buckets" << std::endl;
-    EvictBuckets();
-    std::cout << "End of Execute" << std::endl;
     delete minnode;
-    delete rootnode;
-    return res;
+    pending.minnode = NULL;
+    return pending.result;
 }
 
-HeapNode* DOHEAP::convertBlockToNode(block b) {
-    HeapNode* node = new HeapNode();
-    std::array<byte_t, sizeof (HeapNode) > arr;
-    std::copy(b.begin(), b.begin() + sizeof (HeapNode), arr.begin());
-    from_bytes(arr, *node);
-    node->isDummy = HeapNode::CTeq(node->index, (unsigned long long) 0);
-    return node;
-}
 
-block DOHEAP::convertNodeToBlock(HeapNode* node) {
-    std::array<byte_t, sizeof (HeapNode) > data = to_bytes(*node);
-    block b(data.begin(), data.end());
-    return b;
-}
 
 void DOHEAP::evict(bool evictBuckets) {
     double time;
@@ -693,33 +991,20 @@ void DOHEAP::evict(bool evictBuckets) {
     }
 
     unsigned int j = 0;
-    HeapBucket* bucket = new HeapBucket();
-    bucket->subtree_min.id = 0;
-    bucket->subtree_min.data.resize(blockSize, 0);
+    HeapBucket bucket = HeapBucket();
     for (int i = 0; i < (depth + 1) * Z; i++) {
         HeapNode* cureNode = stash.nodes[i];
         long long curBucketID = cureNode->evictionNode;
-        HeapBlock &curBlock = (*bucket).blocks[j];
-        curBlock.data.resize(blockSize, 0);
-        block tmp = convertNodeToBlock(cureNode);
-        curBlock.id = HeapNode::conditional_select((unsigned long long) 0, cureNode->index, cureNode->isDummy);
-        for (int k = 0; k < tmp.size(); k++) {
-            curBlock.data[k] = HeapNode::conditional_select(curBlock.data[k], tmp[k], cureNode->isDummy);
-        }
+        SetSlot(bucket, j, cureNode);
         delete cureNode;
         j++;
 
         if (j == Z) {
-            virtualStorage.erase(curBucketID);
-            virtualStorage[curBucketID] = (*bucket);
-            delete bucket;
-            bucket = new HeapBucket();
-            bucket->subtree_min.id = 0;
-            bucket->subtree_min.data.resize(blockSize, 0);
+            virtualStorage[curBucketID] = bucket;
+            bucket = HeapBucket();
             j = 0;
         }
     }
-    delete bucket;
 
     if (profile) {
         time = ocall_stop_timer(10);
@@ -782,6 +1067,7 @@ unsigned long long DOHEAP::RandomPath() {
 }
 
 DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long long, unsigned long long> permutation) : gen(rd()) {
+    WriteBack::HeapStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = uniform_int_distribution<long long>(0, maxOfRandom - 1);
@@ -789,15 +1075,15 @@ DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long lo
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
     stash.preAllocate(PERMANENT_STASH_SIZE * 4);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n", depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n", depth);
 
     nextDummyCounter = INF;
     blockSize = sizeof (HeapNode); // B  
-    printf("block size is:%d\n", (int)blockSize);
+    LOG_INFO("block size is:%d\n", (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
-    storeBlockSize = (size_t)Z * (size_t)(blockSize);
-    plaintext_size = (size_t)(blockSize) * (size_t)Z;
+    storeBlockSize = sizeof (HeapBucket);
+    plaintext_size = sizeof (HeapBucket);
     ocall_setup_heapStore(blockCount, storeBlockSize);
     maxHeightOfAVLTree = (int) floor(log2(blockCount)) + 1;
 
@@ -811,7 +1097,7 @@ DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long lo
     double time;
 
     unsigned int j = 0;
-    HeapBucket* bucket = new HeapBucket();
+    HeapBucket bucket = HeapBucket();
 
 
 
@@ -865,26 +1151,19 @@ DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long lo
 
     for (unsigned int i = 0; i < nodes->size(); i++) {
         if (i % 100000 == 0 && i != 0) {
-            printf("Creating Buckets:%d/%d\n", (int)i, (int)nodes->size());
+            LOG_INFO("Creating Buckets:%d/%d\n", (int)i, (int)nodes->size());
         }
         HeapNode* cureNode = (*nodes)[i];
         long long curBucketID = (*nodes)[i]->evictionNode;
 
-        HeapBlock &curBlock = (*bucket).blocks[j];
-        curBlock.data.resize(blockSize, 0);
-        block tmp = convertNodeToBlock(cureNode);
-        curBlock.id = HeapNode::conditional_select((unsigned long long) 0, cureNode->index, cureNode->isDummy);
-        for (int k = 0; k < tmp.size(); k++) {
-            curBlock.data[k] = HeapNode::conditional_select(curBlock.data[k], tmp[k], cureNode->isDummy);
-        }
+        SetSlot(bucket, j, cureNode);
         delete cureNode;
         j++;
 
         if (j == Z) {
             indexes.push_back(curBucketID);
-            buckets.push_back((*bucket));
-            delete bucket;
-            bucket = new HeapBucket();
+            buckets.push_back(bucket);
+            bucket = HeapBucket();
             j = 0;
         }
     }
@@ -916,17 +1195,10 @@ DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long lo
 
     for (int i = 0; i < first_bucket_of_last_level; i++) {
         if (i % 100000 == 0 && i != 0) {
-            printf("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
-        }
-        for (int z = 0; z < Z; z++) {
-            HeapBlock &curBlock = (*bucket).blocks[z];
-            curBlock.id = 0;
-            curBlock.data.resize(blockSize, 0);
+            LOG_INFO("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
         }
         indexes.push_back(i);
-        buckets.push_back((*bucket));
-        delete bucket;
-        bucket = new HeapBucket();
+        buckets.push_back(HeapBucket());
     }
 
     if (beginProfile) {
@@ -935,8 +1207,6 @@ DOHEAP::DOHEAP(long long maxSize, vector<HeapNode*>* nodes, map<unsigned long lo
         ocall_start_timer(10);
     }
 
-    delete bucket;
-
     for (unsigned int j = 0; j <= indexes.size() / 10000; j++) {
         char* tmp = new char[10000 * storeBlockSize];
         size_t cipherSize = 0;
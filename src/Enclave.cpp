@@ -3,9 +3,18 @@
 #include "string.h"
 #include <algorithm>
 #include <math.h>
+#include <thread>
+#include <stdexcept>
 #include "OMAP.h"
 #include "RAMStoreEnclaveInterface.h"
+#include "WriteBack.h"
 #include "GraphNode.h"
+#include "GraphObliviousOperations.h"
+#include "VertexProgramEngine.h"
+#include "VertexPrograms.h"
+#include "KeyValueOperations.h"
+#include "GraphKeys.h"
+#include "Log.h"
 
 #define MY_MAX 9999999
 #define KV_MAX_SIZE 8192
@@ -35,7 +44,20 @@ void check_memory4(string text) {
 int vertexNumber = 0;
 int edgeNumber = 0;
 int maximumPad = 0;
-map<Bid, string> finalPairs;
+char *graphEdges = NULL;
+int graphOp = -1;
+int multiSourceInstances = 0;
+/**
+ * Shards of the oblivious array that keeps the SSSP distances ("/v",
+ * "/v-j"); 0 keeps them in the OMAP
+ */
+int vertexArrayShards = 0;
+bool queryStateDirty = false;
+vector<Node> kvBuffers[2];
+vector<long long> kvIndexes[2];
+int kvActive = 0;
+size_t kvFill = 0;
+std::thread kvWriter;
 long long KV_index = 0;
 unsigned long long edgeBlockSize = sizeof (GraphNode);
 unsigned long long edgeClenSize = edgeBlockSize;
@@ -50,45 +72,55 @@ unsigned long long pairClenSize = pairBlockSize;
 unsigned long long pairPlaintextSize = (pairBlockSize);
 unsigned long long pairStoreSingleBlockSize = pairClenSize;
 
-string readOMAP(string omapKey) {
-    std::array< uint8_t, ID_SIZE > keyArray;
-    keyArray.fill(0);
-    std::copy(omapKey.begin(), omapKey.end(), std::begin(keyArray));
-
-    char* value = new char[16];
-    ecall_read_node((const char*) keyArray.data(), value);
-    string result(value);
-    delete value;
-    return result;
+string readOMAP(const fixed_kv& omapKey) {
+    fixed_kv value;
+    ecall_read_node((const char*) omapKey.data(), (char*) value.data());
+    return KeyValueOperations::toString(value);
 }
 
-void writeOMAP(string omapKey, string omapValue) {
-    std::array< uint8_t, ID_SIZE > keyArray;
-    keyArray.fill(0);
-    std::copy(omapKey.begin(), omapKey.end(), std::begin(keyArray));
-
-    std::array< uint8_t, 16 > valueArray;
-    valueArray.fill(0);
-    std::copy(omapValue.begin(), omapValue.end(), std::begin(valueArray));
-
-    ecall_write_node((const char*) keyArray.data(), (const char*) valueArray.data());
+void writeOMAP(const fixed_kv& omapKey, string omapValue) {
+    fixed_kv value = KeyValueOperations::make(omapValue.c_str());
+    ecall_write_node((const char*) omapKey.data(), (const char*) value.data());
 }
 
-string readWriteOMAP(string omapKey, string omapValue) {
-    std::array< uint8_t, ID_SIZE > keyArray;
-    keyArray.fill(0);
-    std::copy(omapKey.begin(), omapKey.end(), std::begin(keyArray));
+string readWriteOMAP(const fixed_kv& omapKey, string omapValue) {
+    fixed_kv value = KeyValueOperations::make(omapValue.c_str()), oldValue;
+    ecall_read_write_node((const char*) omapKey.data(), (const char*) value.data(), (char*) oldValue.data());
+    return KeyValueOperations::toString(oldValue);
+}
 
-    std::array< uint8_t, 16 > valueArray;
-    valueArray.fill(0);
-    std::copy(omapValue.begin(), omapValue.end(), std::begin(valueArray));
-    char* oldvalue = new char[16];
-    ecall_read_write_node((const char*) keyArray.data(), (const char*) valueArray.data(), oldvalue);
-    string result(oldvalue);
-    delete oldvalue;
+/**
+ * Fused OMAP access, see OMAP::multiAccess. Returns the values from before
+ * the updates.
+ */
+vector<string> multiAccessOMAP(const vector<fixed_kv>& omapKeys, const vector<string>& omapValues, const vector<int>& writeModes) {
+    int count = omapKeys.size();
+    vector<char> values(count * 16, 0), results(count * 16, 0);
+    for (int i = 0; i < count; i++) {
+        std::copy(omapValues[i].begin(), omapValues[i].end(), values.begin() + i * 16);
+    }
+    ecall_multi_access_nodes(count, (const char*) omapKeys.data(), values.data(), writeModes.data(), results.data());
+    vector<string> result(count);
+    for (int i = 0; i < count; i++) {
+        result[i] = string(results.data() + i * 16, strnlen(results.data() + i * 16, 16));
+    }
     return result;
 }
 
+/**
+ * Fused OMAP access on fixed-size keys and values, without allocations on
+ * the caller side
+ */
+void multiAccessOMAP(const fixed_kv *keys, const fixed_kv *values, const int *writeModes, fixed_kv *results, int count) {
+    ecall_multi_access_nodes(count, (const char*) keys, (const char*) values, writeModes, (char*) results);
+}
+
+/**
+ * Overwrites all (distinct) keys with one fused OMAP access
+ */
+void batchWriteOMAP(const vector<fixed_kv>& omapKeys, const vector<string>& omapValues) {
+    multiAccessOMAP(omapKeys, omapValues, vector<int>(omapKeys.size(), WRITE_ALWAYS));
+}
 
 vector<string> splitData(const string& str, const string& delim) {
     vector<string> tokens = {"", ""};
@@ -127,13 +159,13 @@ string CTString(string a, string b, int choice) {
     for (int i = 0; i < maxSize; i++) {
         result += (~((unsigned int) choice - one) & a.at(i)) | ((unsigned int) (choice - one) & b.at(i));
     }
-    result.erase(std::find_if(result.rbegin(), result.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), result.end());
+    result.erase(std::find_if(result.rbegin(), result.rend(), [](unsigned char c) { return !std::isspace(c); }).base(), result.end());
     return result;
 }
 
 bool CTeq(string a, string b) {
-    a.erase(std::find_if(a.rbegin(), a.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), a.end());
-    b.erase(std::find_if(b.rbegin(), b.rend(), std::not1(std::ptr_fun<int, int>(std::isspace))).base(), b.end());
+    a.erase(std::find_if(a.rbegin(), a.rend(), [](unsigned char c) { return !std::isspace(c); }).base(), a.end());
+    b.erase(std::find_if(b.rbegin(), b.rend(), [](unsigned char c) { return !std::isspace(c); }).base(), b.end());
     bool res = Node::CTeq((int) a.length(), (int) b.length());
     for (int i = 0; i < min((int) a.length(), (int) b.length()); i++) {
         res = Node::conditional_select(false, res, !Node::CTeq(a.at(i), b.at(i)));
@@ -141,57 +173,131 @@ bool CTeq(string a, string b) {
     return res;
 }
 
-void addKeyValuePair(string key, string value)
+/**
+ * Hands the filled pair buffer to the writer thread and switches to the
+ * other one, so packing the next batch overlaps with the store write of
+ * this one.
+ */
+void flushKeyValuePairs()
+{
+    if (kvWriter.joinable())
+    {
+        kvWriter.join();
+    }
+    if (kvFill > 0)
+    {
+        int current = kvActive;
+        size_t count = kvFill;
+        kvWriter = std::thread([current, count]() {
+            ocall_nwrite_rawRamStore_for_graph(count, kvIndexes[current].data(), (const char *)kvBuffers[current].data(), storeSingleBlockSize * count);
+        });
+        kvActive = 1 - kvActive;
+        kvFill = 0;
+    }
+}
+
+/**
+ * Packs a setup pair straight into the active flat Node buffer. An empty
+ * key and value flushes the remaining pairs and waits for the writer.
+ */
+void addKeyValuePair(const fixed_kv& key, string value)
 {
-    if (key != "")
+    if (kvBuffers[kvActive].empty())
+    {
+        for (int i = 0; i < 2; i++)
+        {
+            kvBuffers[i].resize(KV_MAX_SIZE);
+            kvIndexes[i].resize(KV_MAX_SIZE);
+        }
+    }
+    if (!KeyValueOperations::isEmpty(key))
+    {
+        Node &node = kvBuffers[kvActive][kvFill];
+        std::memset((void *)&node, 0, sizeof(Node));
+        std::memcpy(node.key.id.data(), key.data(), ID_SIZE);
+        std::memcpy(node.value.data(), value.data(), min(value.size(), node.value.size()));
+        node.leftPos = -1;
+        node.rightPos = -1;
+        node.height = 1; // new node is initially added at leaf
+        kvIndexes[kvActive][kvFill] = KV_index;
+        KV_index++;
+        kvFill++;
+    }
+    if (kvFill == KV_MAX_SIZE)
     {
-        string omapKey = key;
-        std::array<uint8_t, ID_SIZE> keyArray;
-        keyArray.fill(0);
-        std::copy(omapKey.begin(), omapKey.end(), std::begin(keyArray));
-        std::array<byte_t, ID_SIZE> id;
-        std::memcpy(id.data(), (const char *)keyArray.data(), ID_SIZE);
-        Bid inputBid(id);
-        finalPairs[inputBid] = value;
-    }
-    if (finalPairs.size() == KV_MAX_SIZE || ((key == "") && (value == "")))
+        flushKeyValuePairs();
+    }
+    else if (KeyValueOperations::isEmpty(key) && (value == ""))
     {
-        char *tmp = new char[finalPairs.size() * storeSingleBlockSize];
-        vector<long long> indexes;
-        long long j = 0;
-        for (auto pair : finalPairs)
+        flushKeyValuePairs();
+        if (kvWriter.joinable())
         {
-            Node *node = new Node();
-            node->key = pair.first;
-            node->index = 0;
-            std::fill(node->value.begin(), node->value.end(), 0);
-            std::copy(pair.second.begin(), pair.second.end(), node->value.begin());
-            node->leftID = 0;
-            node->leftPos = -1;
-            node->rightPos = -1;
-            node->rightID = 0;
-            node->pos = 0;
-            node->isDummy = false;
-            node->height = 1; // new node is initially added at leaf
+            kvWriter.join();
+        }
+    }
+}
 
-            indexes.push_back(KV_index);
-            KV_index++;
+/**
+ * Adds the per-vertex pairs the selected algorithm (op) works on. Vertex 0
+ * gets the scratch keys the oblivious drivers use as dummy targets.
+ * @return number of added pairs
+ */
+long long addAlgorithmPairs(int v, int op)
+{
+    if (op == 1)
+    {
+        addKeyValuePair(graphKey(QUEUE_KEY, v), "");
+        addKeyValuePair(graphKey(LEVEL_KEY, v), "");
+        return 2;
+    }
+    else if (op == 2)
+    {
+        addKeyValuePair(graphKey(VERTEX_KEY, v), to_string(v));
+        return 1;
+    }
+    else if (op == 3 && vertexArrayShards > 0)
+    {
+        return 0;
+    }
+    else if (op == 3)
+    {
+        addKeyValuePair(graphKey(VERTEX_KEY, v), v == 0 ? "0" : to_string(MY_MAX));
+        // per-source distances of the multi-source SSSP
+        for (int j = 1; j <= multiSourceInstances; j++)
+        {
+            addKeyValuePair(graphKey(VERTEX_KEY, v, j), v == 0 ? "0" : to_string(MY_MAX));
+        }
+        return 1 + multiSourceInstances;
+    }
+    return 0;
+}
 
-            std::array<byte_t, sizeof(Node)> data;
+/**
+ * Capacity of the graph OMAP: the edge and vertex pairs plus one distance
+ * per vertex for every multi-source SSSP instance
+ */
+long long omapCapacity()
+{
+    return ((long long)vertexNumber * (1 + multiSourceInstances) + edgeNumber) * 4;
+}
 
-            const byte_t *begin = reinterpret_cast<const byte_t *>(std::addressof(((*node))));
-            const byte_t *end = begin + sizeof(Node);
-            std::copy(begin, end, std::begin(data));
+void ecall_use_vertex_array(int shards)
+{
+    vertexArrayShards = shards;
+}
 
-            block buffer(data.begin(), data.end());
-            std::memcpy(tmp + j * buffer.size(), buffer.data(), storeSingleBlockSize);
-            delete node;
-            j++;
-        }
-        ocall_nwrite_rawRamStore_for_graph(finalPairs.size(), indexes.data(), (const char *)tmp, storeSingleBlockSize * finalPairs.size());
-        delete tmp;
-        finalPairs.clear();
+/**
+ * Places the distances of the SSSP algorithms into an oblivious array
+ * (see ecall_place_array_namespace) and sets their initial values
+ */
+void placeVertexArray()
+{
+    if (vertexArrayShards == 0 || graphOp != 3)
+    {
+        return;
     }
+    ecall_place_array_namespace(VERTEX_KEY, vertexNumber + 1, multiSourceInstances + 1, vertexArrayShards);
+    ecall_reset_query_state();
 }
 
 void ecall_pad_nodes(char **edgeList)
@@ -211,23 +317,26 @@ void ecall_pad_nodes(char **edgeList)
     }
 }
 
-void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList, int op = -1)
+void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList, int op = -1, int instances = 0)
 {
     size_t depth = (int)(ceil(log2(vSize)) - 1) + 1;
     long long maxOfRandom = (long long)(pow(2, depth));
     vertexNumber = vSize;
     edgeNumber = eSize;
+    multiSourceInstances = instances;
     maximumPad = (int)pow(2, ceil(log2(edgeNumber)));
     long long KVNumber = 0;
 
     OMAP *omap = new OMAP(maxOfRandom, vSize);
 
-    unsigned long long maxSize = (vertexNumber + edgeNumber) * 4;
+    unsigned long long maxSize = omapCapacity();
     depth = (int)(ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long)(pow(2, depth));
     unsigned long long bucketCount = maxOfRandom * 2 - 1;
     unsigned long long blockSize = sizeof(Node); // B
     unsigned long long blockCount = (size_t)(Z * bucketCount);
+    // queued flushes go to the store of the mode they were made in
+    WriteBack::RamStore().drain();
     ocall_finish_setup();
     ocall_setup_ramStore(blockCount, blockSize);
     ocall_begin_setup();
@@ -235,25 +344,19 @@ void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList,
     for (int i = 0; i < eSize; i++)
     {
         if (i % 100 == 0)
-            printf("%d/%d of edges processed\n", i, eSize);
+            LOG_INFO("%d/%d of edges processed\n", i, eSize);
         block buffer((*edgeList) + i * edgeStoreSingleBlockSize,
                      (*edgeList) + (i + 1) * edgeStoreSingleBlockSize);
         GraphNode *curEdge = GraphNode::convertBlockToNode(buffer);
 
-        string srcBid = "?" + to_string(curEdge->src_id);
-        std::array<byte_t, ID_SIZE> srcid;
-        std::memcpy(srcid.data(), srcBid.data(), ID_SIZE);
-        Bid srcInputBid(srcid);
+        Bid srcInputBid(graphKey(DEGREE_KEY, curEdge->src_id));
         string srcCntStr = omap->incPart(srcInputBid, true);
 
         vector<string> parts = splitData(srcCntStr, "-");
         int outSrc = std::stoi(parts[0]) + 1;
         int inSrc = std::stoi(parts[1]);
 
-        string dstBid = "?" + to_string(curEdge->dst_id);
-        std::array<byte_t, ID_SIZE> dstid;
-        std::memcpy(dstid.data(), dstBid.data(), ID_SIZE);
-        Bid dstInputBid(dstid);
+        Bid dstInputBid(graphKey(DEGREE_KEY, curEdge->dst_id));
         string dstCntStr = omap->incPart(dstInputBid, false);
 
         parts = splitData(dstCntStr, "-");
@@ -264,15 +367,15 @@ void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList,
         string dst = to_string(curEdge->dst_id);
         string weight = to_string(curEdge->weight);
 
-        addKeyValuePair("$" + src + "-" + to_string(outSrc), dst + "-" + weight);
-        addKeyValuePair("*" + dst + "-" + to_string(inDst), src + "-" + weight);
-        addKeyValuePair("!" + src + "-" + dst, weight + "-" + to_string(outSrc) + "-" + to_string(inDst));
+        addKeyValuePair(graphKey(OUT_EDGE_KEY, curEdge->src_id, outSrc), dst + "-" + weight);
+        addKeyValuePair(graphKey(IN_EDGE_KEY, curEdge->dst_id, inDst), src + "-" + weight);
+        addKeyValuePair(graphKey(EDGE_KEY, curEdge->src_id, curEdge->dst_id), weight + "-" + to_string(outSrc) + "-" + to_string(inDst));
         KVNumber += 3;
 
         // SSSP SETUP
         if (op == 3)
         {
-            addKeyValuePair("&" + to_string(i), "0-0");
+            addKeyValuePair(graphKey(HEAP_KEY, i), "0-0");
             KVNumber++;
         }
 
@@ -283,67 +386,191 @@ void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList,
     {
         if (i % 100 == 0)
         {
-            printf("%d/%d of vertices processed\n", i, (int)vSize);
-        }
-        string bid = "?" + to_string(i);
-        std::array<byte_t, ID_SIZE> id;
-        std::memcpy(id.data(), bid.data(), ID_SIZE);
-        Bid inputBid(id);
-        string value = omap->find(inputBid);
-        addKeyValuePair(bid, value);
+            LOG_INFO("%d/%d of vertices processed\n", i, (int)vSize);
+        }
+        fixed_kv degreeKey = graphKey(DEGREE_KEY, i);
+        string value = omap->find(Bid(degreeKey));
+        addKeyValuePair(degreeKey, value);
         KVNumber++;
 
+        KVNumber += addAlgorithmPairs(i, op);
+    }
+    KVNumber += addAlgorithmPairs(0, op);
+    addKeyValuePair(fixed_kv{}, "");
+    ecall_pad_nodes(edgeList);
+    graphEdges = *edgeList;
+    graphOp = op;
+
+    WriteBack::RamStore().drain();
+    ocall_finish_setup();
+    ecall_setup_omap_with_small_memory(omapCapacity(), KVNumber);
+    placeVertexArray();
+}
+
+/**
+ * Flat record used by the sort-based setup. Edge entries carry their out/in
+ * ordinals; vertex entries (isVertex = 1, src_id = dst_id = v) end up with
+ * the out/in degree of v.
+ */
+struct SetupRecord {
+    int src_id;
+    int dst_id;
+    int weight;
+    int isVertex;
+    int outCnt;
+    int inCnt;
+};
+
+/**
+ * Counts consecutive records of the same group (given by groupOf) in a
+ * single linear pass. Edge records get their 1-based ordinal inside the
+ * group, and the vertex record that closes a group gets the group size.
+ */
+template <typename GroupFn, typename CountFn>
+void prefixCountScan(vector<SetupRecord>& records, GroupFn groupOf, CountFn countOf)
+{
+    int prev = -1, cnt = 0;
+    for (auto& r : records)
+    {
+        bool same = Node::CTeq(groupOf(r), prev);
+        int next = Node::conditional_select(cnt + 1, 1, same);
+        countOf(r) = Node::conditional_select(Node::conditional_select(cnt, 0, same), next, r.isVertex);
+        cnt = next;
+        prev = groupOf(r);
+    }
+}
+
+/**
+ * Builds the same $, *, ! and ? pairs as ecall_setup_with_small_memory
+ * without the temporary counter OMAP: edges and vertices are sorted
+ * obliviously by source and by destination, and ordinals/degrees come out
+ * of a linear prefix-count scan after each sort. A last sort puts all edge
+ * records before the vertex records, so emitting the pairs only depends
+ * on the public edge and vertex counts.
+ */
+void ecall_setup_with_oblivious_sort(int eSize, long long vSize, char **edgeList, int op = -1, int instances = 0)
+{
+    vertexNumber = vSize;
+    edgeNumber = eSize;
+    multiSourceInstances = instances;
+    maximumPad = (int)pow(2, ceil(log2(edgeNumber)));
+    long long KVNumber = 0;
+
+    unsigned long long maxSize = omapCapacity();
+    size_t depth = (int)(ceil(log2(maxSize)) - 1) + 1;
+    long long maxOfRandom = (long long)(pow(2, depth));
+    unsigned long long bucketCount = maxOfRandom * 2 - 1;
+    unsigned long long blockCount = (size_t)(Z * bucketCount);
+    WriteBack::RamStore().drain();
+    ocall_finish_setup();
+    ocall_setup_ramStore(blockCount, sizeof(Node));
+
+    vector<SetupRecord> records(eSize + vSize);
+    for (int i = 0; i < eSize; i++)
+    {
+        GraphNode edge;
+        std::memcpy(&edge, (*edgeList) + i * edgeStoreSingleBlockSize, sizeof(GraphNode));
+        records[i] = {edge.src_id, edge.dst_id, edge.weight, 0, 0, 0};
+    }
+    for (int i = 1; i <= vSize; i++)
+    {
+        records[eSize + i - 1] = {i, i, 0, 1, 0, 0};
+    }
+
+    GraphObliviousOperations::bitonicSort(&records, [](const SetupRecord& r) {
+        return ((unsigned long long)r.src_id << 32) | ((unsigned long long)r.isVertex << 31) | (unsigned long long)r.dst_id;
+    });
+    prefixCountScan(records, [](SetupRecord& r) { return r.src_id; }, [](SetupRecord& r) -> int& { return r.outCnt; });
+
+    GraphObliviousOperations::bitonicSort(&records, [](const SetupRecord& r) {
+        return ((unsigned long long)r.dst_id << 32) | ((unsigned long long)r.isVertex << 31) | (unsigned long long)r.src_id;
+    });
+    prefixCountScan(records, [](SetupRecord& r) { return r.dst_id; }, [](SetupRecord& r) -> int& { return r.inCnt; });
+
+    GraphObliviousOperations::bitonicSort(&records, [](const SetupRecord& r) {
+        return ((unsigned long long)r.isVertex << 62) | ((unsigned long long)r.src_id << 31) | (unsigned long long)r.dst_id;
+    });
+
+    for (int i = 0; i < eSize; i++)
+    {
+        string src = to_string(records[i].src_id);
+        string dst = to_string(records[i].dst_id);
+        string weight = to_string(records[i].weight);
+        string outSrc = to_string(records[i].outCnt);
+        string inDst = to_string(records[i].inCnt);
+
+        addKeyValuePair(graphKey(OUT_EDGE_KEY, records[i].src_id, records[i].outCnt), dst + "-" + weight);
+        addKeyValuePair(graphKey(IN_EDGE_KEY, records[i].dst_id, records[i].inCnt), src + "-" + weight);
+        addKeyValuePair(graphKey(EDGE_KEY, records[i].src_id, records[i].dst_id), weight + "-" + outSrc + "-" + inDst);
+        KVNumber += 3;
+
         // SSSP SETUP
-        if (op == 1)
-        {
-            bid = "@" + to_string(i);
-            value = "";
-            addKeyValuePair(bid, value);
-            KVNumber++;
-            bid = "%" + to_string(i);
-            value = "";
-            addKeyValuePair(bid, value);
-            KVNumber++;
-        }
-        else if (op == 2)
-        {
-            bid = "/" + to_string(i);
-            value = to_string(i);
-            addKeyValuePair(bid, value);
-            KVNumber++;
-        }
-        else if (op == 3)
+        if (op == 3)
         {
-            bid = "/" + to_string(i);
-            value = to_string(MY_MAX);
-            addKeyValuePair(bid, value);
+            addKeyValuePair(graphKey(HEAP_KEY, i), "0-0");
             KVNumber++;
         }
     }
 
-    if (op == 1)
+    for (int i = eSize; i < eSize + vSize; i++)
     {
-        string bid = "@" + to_string(0);
-        string value = "";
-        addKeyValuePair(bid, value);
-        KVNumber++;
-        bid = "%" + to_string(0);
-        value = "";
-        addKeyValuePair(bid, value);
+        int v = records[i].src_id;
+        addKeyValuePair(graphKey(DEGREE_KEY, v), to_string(records[i].outCnt) + "-" + to_string(records[i].inCnt));
         KVNumber++;
+        KVNumber += addAlgorithmPairs(v, op);
     }
-    else if (op == 2 || op == 3)
-    {
-        string bid = "/" + to_string(0);
-        string value = to_string(0);
-        addKeyValuePair(bid, value);
-        KVNumber++;
-    }
-    addKeyValuePair("", "");
+    KVNumber += addAlgorithmPairs(0, op);
+    addKeyValuePair(fixed_kv{}, "");
     ecall_pad_nodes(edgeList);
+    graphEdges = *edgeList;
+    graphOp = op;
 
-    ocall_finish_setup();
-    ecall_setup_omap_with_small_memory((vertexNumber + edgeNumber) * 4, KVNumber);
+    ecall_setup_omap_with_small_memory(omapCapacity(), KVNumber);
+    placeVertexArray();
+}
+
+/**
+ * Persists the set-up graph. The trusted state (graph sizes, padded edge
+ * list, OMAP root and stash) is passed as one blob, and the ORAM buckets
+ * are written from the untrusted store as they are.
+ */
+void ecall_save_snapshot(const char *path)
+{
+    block state;
+    append_bytes(state, graphOp);
+    append_bytes(state, vertexNumber);
+    append_bytes(state, edgeNumber);
+    append_bytes(state, maximumPad);
+    append_bytes(state, multiSourceInstances);
+    append_bytes(state, vertexArrayShards);
+    state.insert(state.end(), (byte_t *)graphEdges, (byte_t *)graphEdges + maximumPad * edgeStoreSingleBlockSize);
+    ecall_checkpoint_omap(&state);
+    ocall_write_snapshot(path, (const char *)state.data(), state.size());
+}
+
+/**
+ * Restores a graph saved by ecall_save_snapshot. The store is mapped back
+ * from the file, so none of the setup work is redone.
+ * @return the algorithm (op) the snapshot was set up for
+ */
+int ecall_restore_snapshot(const char *path)
+{
+    block state;
+    ocall_map_snapshot(path, &state);
+    const byte_t *cursor = state.data();
+    read_bytes(cursor, graphOp);
+    read_bytes(cursor, vertexNumber);
+    read_bytes(cursor, edgeNumber);
+    read_bytes(cursor, maximumPad);
+    read_bytes(cursor, multiSourceInstances);
+    read_bytes(cursor, vertexArrayShards);
+    graphEdges = new char[maximumPad * edgeStoreSingleBlockSize];
+    std::memcpy(graphEdges, cursor, maximumPad * edgeStoreSingleBlockSize);
+    cursor += maximumPad * edgeStoreSingleBlockSize;
+    ecall_restore_omap(omapCapacity(), &cursor);
+    // the distances are query state, so the array is not part of the snapshot
+    placeVertexArray();
+    return graphOp;
 }
 
 //SSSP with oblivm version min heap
@@ -351,33 +578,36 @@ void ecall_setup_with_small_memory(int eSize, long long vSize, char **edgeList,
 void ecall_oblivm_single_source_shortest_path(int src) {
     ecall_setup_oheap(edgeNumber);
 
-    std::cout << "set up oheap" << std::endl;
+    LOG_INFO("set up oheap\n");
 
     ocall_start_timer(34);
-    for (int i = 1; i <= vertexNumber; i++) {
-        std::cout << "init dist of " << i << std::endl;
-        writeOMAP("/" + to_string(i), to_string(MY_MAX));
+    if (graphOp == 3) {
+        ecall_reset_query_state();
+    } else {
+        for (int i = 1; i <= vertexNumber; i++) {
+            LOG_TRACE("init dist of %d\n", i);
+            writeOMAP(graphKey(VERTEX_KEY, i), to_string(MY_MAX));
+        }
     }
 
-    writeOMAP("/" + to_string(src), "0");
-    std::cout << "readWriteOMAP" << std::endl;
+    writeOMAP(graphKey(VERTEX_KEY, src), "0");
+    LOG_TRACE("readWriteOMAP\n");
     ecall_set_new_minheap_node(src - 1, 0);
-    std::cout << "Start with source node " << src << std::endl;
+    LOG_INFO("Start with source node %d\n", src);
 
     bool innerloop = false;
-    string dstStr, omapKey;
+    string dstStr;
     int u = -1, cnt = 1, distu = -1, curDistU = -1;
 
     for (int i = 0; i < (2 * vertexNumber + edgeNumber); i++) {
-        if (i % 1 == 0)
-            printf("sssp: %d/%d\n", i, vertexNumber + edgeNumber);
+        LOG_DEBUG("sssp: %d/%d\n", i, vertexNumber + edgeNumber);
 
         if (innerloop == false)
         {
             u = -1;
             distu = -1;
             ecall_extract_min_id(&u, &distu);
-            std::cout << "u: " << u << ", distu: " << distu << std::endl;
+            LOG_TRACE("u: %d, distu: %d\n", u, distu);
             if (u == -1)
             {
                 u = u;
@@ -386,24 +616,23 @@ void ecall_oblivm_single_source_shortest_path(int src) {
             else
             {
                 u++;
-                string readData = readOMAP("/" + to_string(u));
+                string readData = readOMAP(graphKey(VERTEX_KEY, u));
                 curDistU = std::stoi(readData);
             }
 
             if (curDistU == distu) {
                 cnt = 1;
-                omapKey = "$" + to_string(u) + "-" + to_string(cnt);
-                std::cout << "omapKey: " << omapKey << std::endl;
-                dstStr = readOMAP(omapKey);
+                LOG_TRACE("omapKey: $%d-%d\n", u, cnt);
+                dstStr = readOMAP(graphKey(OUT_EDGE_KEY, u, cnt));
                 if (dstStr != "") {
                     innerloop = true;
                 } else {
                     innerloop = false;
                 }
             } else {
-                writeOMAP("/-", "");
+                writeOMAP(graphKey(DUMMY_KEY, 0), "");
             }
-            writeOMAP("/-", "");
+            writeOMAP(graphKey(DUMMY_KEY, 0), "");
         }
         else
         {
@@ -411,18 +640,17 @@ void ecall_oblivm_single_source_shortest_path(int src) {
             int v = std::stoi(parts[0]);
             int weight = std::stoi(parts[1]);
             int distU = curDistU;
-            int distV = std::stoi(readOMAP("/" + to_string(v)));
+            int distV = std::stoi(readOMAP(graphKey(VERTEX_KEY, v)));
 
             if (weight + distU < distV) {
-                writeOMAP("/" + to_string(v), to_string(distU + weight));
+                writeOMAP(graphKey(VERTEX_KEY, v), to_string(distU + weight));
                 ecall_set_new_minheap_node(v - 1, distU + weight);
             } else {
-                writeOMAP("/-", "");
+                writeOMAP(graphKey(DUMMY_KEY, 0), "");
                 ecall_dummy_heap_op();
             }
             cnt++;
-            omapKey = "$" + to_string(u) + "-" + to_string(cnt);
-            dstStr = readOMAP(omapKey);
+            dstStr = readOMAP(graphKey(OUT_EDGE_KEY, u, cnt));
             if (dstStr != "") {
                 innerloop = true;
             } else {
@@ -433,106 +661,705 @@ void ecall_oblivm_single_source_shortest_path(int src) {
 
     //    printf("Vertex   Distance from Source\n");
     //    for (int i = 1; i <= vertexNumber; i++) {
-    //        printf("%d tt %s\n", i, readOMAP("/" + to_string(i)).c_str());
+    //        printf("%d tt %s\n", i, readOMAP(graphKey(VERTEX_KEY, i)).c_str());
     //    }
 }
 
-void ecall_oblivious_oblivm_single_source_shortest_path(int src) {
-    ecall_setup_oheap(edgeNumber);
-    std::cout << "Setup oheap with " << edgeNumber << " edges" << std::endl;
-    ocall_start_timer(34);
+int ecall_vertex_number() {
+    return vertexNumber;
+}
 
-    readWriteOMAP("/" + to_string(src), "0");
-    std::cout << "readWriteOMAP" << std::endl;
-    ecall_set_new_minheap_node(src - 1, 0);
-    std::cout << "Start with source node " << src << std::endl;
+/**
+ * Restores the per-query OMAP state (the /v distances or the %v levels) left behind by the
+ * previous query, so the set-up graph can answer another source. All /v
+ * keys are rewritten in one pass over the store; only the /0 scratch key
+ * is written back through the tree.
+ */
+void ecall_reset_query_state() {
+    if (graphOp == 1) {
+        ecall_rewrite_prefix("%", "");
+    } else {
+        ecall_rewrite_prefix("/", to_string(MY_MAX).c_str());
+        readWriteOMAP(graphKey(VERTEX_KEY, 0), "0");
+        if (multiSourceInstances > 0) {
+            vector<fixed_kv> keys;
+            for (int j = 1; j <= multiSourceInstances; j++) {
+                keys.push_back(graphKey(VERTEX_KEY, 0, j));
+            }
+            batchWriteOMAP(keys, vector<string>(keys.size(), "0"));
+        }
+    }
+    queryStateDirty = false;
+}
+
+/**
+ * Oblivious Dijkstra from src on DOHEAP, or on the array heap if arrayHeap
+ * is set. Both heaps take the same operations.
+ */
+static void obliviousDijkstra(int src, int *distances, bool arrayHeap) {
+    if (queryStateDirty) {
+        ecall_reset_query_state();
+    }
+    queryStateDirty = true;
+    // relaxations lower the key of v instead of adding an entry, so the
+    // heap never holds more than V entries
+    if (arrayHeap) {
+        ecall_setup_array_heap(vertexNumber);
+    } else {
+        ecall_setup_oheap(vertexNumber, true);
+    }
+    LOG_INFO("Setup oheap with %d vertices\n", vertexNumber);
+    ocall_start_timer(34);
 
+    readWriteOMAP(graphKey(VERTEX_KEY, src), "0");
+    LOG_TRACE("readWriteOMAP\n");
+    if (arrayHeap) {
+        int srcV = src - 1, srcDist = 0;
+        ecall_execute_array_heap_operation(&srcV, &srcDist, 2);
+    } else {
+        ecall_set_new_minheap_node(src - 1, 0);
+    }
+    LOG_INFO("Start with source node %d\n", src);
+
+    typedef KeyValueOperations KV;
+    const fixed_kv zeroPair = KV::make("0-0");
+    const int relaxMode[1] = {WRITE_IF_LESS};
+    const int readModes[2] = {WRITE_NONE, WRITE_NONE};
+    fixed_kv keys[2], values[2], results[2];
+    values[1] = KV::make("");
     bool innerloop = false;
-    string dstStr, omapKey;
+    fixed_kv dstStr = KV::make(""), tmp;
     int u = -1, cnt = 1, distu = -1, distv = -1, v = -1, curDistU = -1, weight = -1;
-    string mapKey = "", mapValue = "", tmp = "";
 
     for (int i = 0; i < (2 * vertexNumber + edgeNumber); i++) {
-        if (i % 1 == 0)
-        {
-            printf("odij: %d/%d\n", i, 2 * vertexNumber + edgeNumber);
-        }
-        bool check = Node::CTeq(dstStr.length(), 0) && !innerloop;
-        dstStr = CTString("0-0", dstStr, check);
-        auto parts = splitData(dstStr, "-");
-        std::cout << "parts: " << parts[0] << ", " << parts[1] << std::endl;
-        v = Node::conditional_select(std::stoi(parts[0]), v, innerloop);
-        //        v = innerloop ? std::stoi(parts[0]) : v;
-        weight = Node::conditional_select(std::stoi(parts[1]), weight, innerloop);
-        //        weight = innerloop ? std::stoi(parts[1]) : weight;       //TODO
+        LOG_DEBUG("odij: %d/%d\n", i, 2 * vertexNumber + edgeNumber);
+        bool check = KV::isEmpty(dstStr) && !innerloop;
+        dstStr = KV::select(zeroPair, dstStr, check);
+        v = Node::conditional_select(KV::field(dstStr, 0), v, innerloop);
+        weight = Node::conditional_select(KV::field(dstStr, 1), weight, innerloop);
         distu = Node::conditional_select(curDistU, -1, innerloop);
-        //        distu = innerloop ? curDistU : -1;
-        std::cout << "v: " << v << ", weight: " << weight << ", distu: " << distu << std::endl;
-
-        mapKey = CTString(to_string(v), "0", innerloop);
-        //        mapKey = innerloop ? to_string(v) : "-";
         u = Node::conditional_select(u, -1, innerloop);
-        //        u = innerloop ? u : -1;
-        std::cout << "mapKey: " << mapKey << ", u: " << u << std::endl;
-        tmp = readOMAP("/" + to_string(v));
-        std::cout << "tmp: " << tmp << std::endl;
-
-        check = Node::CTeq(tmp.length(), 0) && !innerloop;
-        tmp = CTString("0-0", tmp, check);
-        std::cout << "tmp: " << tmp << ", std::stoi(tmp): " << std::stoi(tmp) << std::endl;
-        distv = Node::conditional_select(std::stoi(tmp), distv, innerloop);
-        //        distv = innerloop ? std::stoi(tmp) : distv;
-        mapValue = CTString(to_string(distu + weight), to_string(distv), innerloop && Node::CTeq(Node::CTcmp(distu + weight, distv), -1));
-        //        mapValue = (innerloop && (distu + weight < distv)) ? to_string(distu + weight) : to_string(distv);
-        readWriteOMAP("/" + mapKey, mapValue);
+        LOG_TRACE("v: %d, weight: %d, distu: %d, u: %d\n", v, weight, distu, u);
+
+        // read /v and relax it in the same access; outside the inner loop
+        // the candidate never wins and /0 stays as it is
+        keys[0] = graphKey(VERTEX_KEY, Node::conditional_select(v, 0, innerloop));
+        values[0] = KV::number(Node::conditional_select(distu + weight, MY_MAX, innerloop));
+        multiAccessOMAP(keys, values, relaxMode, results, 1);
+
+        check = KV::isEmpty(results[0]) && !innerloop;
+        tmp = KV::select(zeroPair, results[0], check);
+        distv = Node::conditional_select(KV::field(tmp, 0), distv, innerloop);
+        bool relax = innerloop && Node::CTeq(Node::CTcmp(distu + weight, distv), -1);
 
         int heapOp = 3;
         heapOp = Node::conditional_select(1, heapOp, !innerloop);
-        heapOp = Node::conditional_select(2, heapOp, innerloop && Node::CTeq(Node::CTcmp(distu + weight, distv), -1));
+        heapOp = Node::conditional_select(4, heapOp, relax);
 
         int heapV = u;
         int heapDist = distu;
-        heapV = Node::conditional_select(v - 1, heapV, innerloop && Node::CTeq(Node::CTcmp(distu + weight, distv), -1));
-        heapDist = Node::conditional_select(distu + weight, heapDist, innerloop && Node::CTeq(Node::CTcmp(distu + weight, distv), -1));
+        heapV = Node::conditional_select(v - 1, heapV, relax);
+        heapDist = Node::conditional_select(distu + weight, heapDist, relax);
 
-        ecall_execute_heap_operation(&heapV, &heapDist, heapOp);
+        if (arrayHeap) {
+            ecall_execute_array_heap_operation(&heapV, &heapDist, heapOp);
+        } else {
+            ecall_execute_heap_operation(&heapV, &heapDist, heapOp);
+        }
 
         u = Node::conditional_select(heapV, u, !innerloop);
         distu = Node::conditional_select(heapDist, distu, !innerloop);
-
-        //        if (innerloop == false) {
-        //            ecall_extract_min_id(&u, &distu);
-        //        } else if (innerloop && (distu + weight < distv)) {
-        //            ecall_set_new_minheap_node(v - 1, distu + weight);
-        //        } else {
-        //            ecall_dummy_heap_op();
-        //        }
         cnt = Node::conditional_select(cnt + 1, cnt, innerloop);
-        //        cnt = innerloop ? cnt + 1 : cnt;
         u = Node::conditional_select(u + 1, u, !innerloop && !Node::CTeq(u, -1));
-        mapKey = CTString(to_string(u), "0", !innerloop && !Node::CTeq(u, -1));
-        //        mapKey = ((innerloop == false) && u != -1) ? to_string(++u) : "-";
-        tmp = readOMAP("/" + mapKey);
-
-        check = Node::CTeq(tmp.length(), 0) && (innerloop || Node::CTeq(u, -1));
-        tmp = CTString("0-0", tmp, check);
-        curDistU = Node::conditional_select(std::stoi(tmp), curDistU, !innerloop && !Node::CTeq(u, -1));
-        //        curDistU = ((innerloop == false) && u != -1) ? std::stoi(tmp) : curDistU;
+
+        // the distance of a freshly extracted u and its first (or the next)
+        // adjacency entry are independent, so both are read in one access
+        int nextCnt = Node::conditional_select(cnt, 1, innerloop);
+        keys[0] = graphKey(VERTEX_KEY, Node::conditional_select(u, 0, !innerloop && !Node::CTeq(u, -1)));
+        keys[1] = graphKey(OUT_EDGE_KEY, u, nextCnt);
+        multiAccessOMAP(keys, values, readModes, results, 2);
+
+        check = KV::isEmpty(results[0]) && (innerloop || Node::CTeq(u, -1));
+        tmp = KV::select(zeroPair, results[0], check);
+        curDistU = Node::conditional_select(KV::field(tmp, 0), curDistU, !innerloop && !Node::CTeq(u, -1));
         curDistU = Node::conditional_select(-2, curDistU, !innerloop && Node::CTeq(u, -1));
-        //        curDistU = ((innerloop == false) && u == -1) ? -2 : curDistU;
         cnt = Node::conditional_select(1, cnt, !innerloop && Node::CTeq(curDistU, distu));
         //        cnt = (innerloop == false && curDistU == distu) ? 1 : cnt;
-        tmp = readOMAP("$" + to_string(u) + "-" + to_string(cnt));
 
-        dstStr = CTString(tmp, dstStr, innerloop || Node::CTeq(curDistU, distu));
+        dstStr = KV::select(results[1], dstStr, innerloop || Node::CTeq(curDistU, distu));
         //        dstStr = (innerloop || curDistU == distu) ? tmp : dstStr;
 
-        innerloop = (innerloop && !Node::CTeq(dstStr.length(), 0)) || (!innerloop && Node::CTeq(curDistU, distu) && !Node::CTeq(dstStr.length(), 0));
+        innerloop = (innerloop && !KV::isEmpty(dstStr)) || (!innerloop && Node::CTeq(curDistU, distu) && !KV::isEmpty(dstStr));
         //        innerloop = (innerloop && dstStr != "") || (innerloop == false && curDistU == distu && dstStr != "") ? true : false;
     }
 
+    if (distances != NULL) {
+        for (int i = 1; i <= vertexNumber; i++) {
+            distances[i - 1] = std::stoi(readOMAP(graphKey(VERTEX_KEY, i)));
+        }
+        return;
+    }
     printf("Vertex Distance from Source\n");
     for (int i = 1; i <= vertexNumber; i++) {
-        printf("Destination:%d  Distance:%s\n", i, readOMAP("/" + to_string(i)).c_str());
+        printf("Destination:%d  Distance:%s\n", i, readOMAP(graphKey(VERTEX_KEY, i)).c_str());
+    }
+}
+
+void ecall_oblivious_oblivm_single_source_shortest_path(int src, int *distances) {
+    obliviousDijkstra(src, distances, false);
+}
+
+/**
+ * The oblivious Dijkstra of ecall_oblivious_oblivm_single_source_shortest_path
+ * with the array heap in place of DOHEAP
+ */
+void ecall_oblivious_array_heap_shortest_path(int src, int *distances) {
+    obliviousDijkstra(src, distances, true);
+}
+
+/**
+ * Per-source state of the lockstep multi-source SSSP, the same variables as
+ * the loop of ecall_oblivious_oblivm_single_source_shortest_path
+ */
+struct SSSPInstance {
+    bool innerloop = false;
+    fixed_kv dstStr = KeyValueOperations::make("");
+    int u = -1, cnt = 1, distu = -1, distv = -1, v = -1, curDistU = -1, weight = -1;
+};
+
+/**
+ * Runs the oblivious SSSP from k sources in lockstep. Every iteration does
+ * the accesses of one single-source iteration for all k instances, and the
+ * OMAP accesses of the same kind (the relaxation of "/v", and the reads of
+ * "/u" and "$u-cnt") go through one fused traversal, so their ORAM paths
+ * are read with one store ocall per tree level. Instance j keeps its distances in
+ * the "/v-j" keys and its heap in the j-th heap of a shared heap store, and
+ * the k heap operations of an iteration share one pass over that store.
+ * @param distances k * V distances, source by source (printed if NULL)
+ */
+void ecall_oblivious_multi_source_shortest_path(const int *sources, int k, int *distances) {
+    if (k > multiSourceInstances) {
+        throw runtime_error("graph was set up for " + to_string(multiSourceInstances) + " sources");
+    }
+    if (queryStateDirty) {
+        ecall_reset_query_state();
+    }
+    queryStateDirty = true;
+    ecall_setup_oheaps(k, vertexNumber, true);
+    LOG_INFO("Setup %d oheaps with %d vertices\n", k, vertexNumber);
+    ocall_start_timer(34);
+
+    vector<fixed_kv> keys(k);
+    for (int j = 0; j < k; j++) {
+        keys[j] = graphKey(VERTEX_KEY, sources[j], j + 1);
+    }
+    batchWriteOMAP(keys, vector<string>(k, "0"));
+    for (int j = 0; j < k; j++) {
+        int heapV = sources[j] - 1, heapDist = 0;
+        ecall_execute_heap_operation_on(j, &heapV, &heapDist, 2);
+    }
+
+    typedef KeyValueOperations KV;
+    const fixed_kv zeroPair = KV::make("0-0");
+    const vector<int> relaxModes(k, WRITE_IF_LESS), readModes(2 * k, WRITE_NONE);
+    vector<fixed_kv> accessKeys(2 * k), accessValues(2 * k, KV::make("")), results(2 * k);
+    vector<SSSPInstance> state(k);
+    vector<int> heapV(k), heapDist(k), heapOps(k);
+    for (int i = 0; i < (2 * vertexNumber + edgeNumber); i++) {
+        LOG_DEBUG("modij: %d/%d\n", i, 2 * vertexNumber + edgeNumber);
+
+        for (int j = 0; j < k; j++) {
+            SSSPInstance& s = state[j];
+            bool check = KV::isEmpty(s.dstStr) && !s.innerloop;
+            s.dstStr = KV::select(zeroPair, s.dstStr, check);
+            s.v = Node::conditional_select(KV::field(s.dstStr, 0), s.v, s.innerloop);
+            s.weight = Node::conditional_select(KV::field(s.dstStr, 1), s.weight, s.innerloop);
+            s.distu = Node::conditional_select(s.curDistU, -1, s.innerloop);
+            s.u = Node::conditional_select(s.u, -1, s.innerloop);
+            accessKeys[j] = graphKey(VERTEX_KEY, Node::conditional_select(s.v, 0, s.innerloop), j + 1);
+            accessValues[j] = KV::number(Node::conditional_select(s.distu + s.weight, MY_MAX, s.innerloop));
+        }
+        multiAccessOMAP(accessKeys.data(), accessValues.data(), relaxModes.data(), results.data(), k);
+
+        for (int j = 0; j < k; j++) {
+            SSSPInstance& s = state[j];
+            bool check = KV::isEmpty(results[j]) && !s.innerloop;
+            fixed_kv tmp = KV::select(zeroPair, results[j], check);
+            s.distv = Node::conditional_select(KV::field(tmp, 0), s.distv, s.innerloop);
+            bool relax = s.innerloop && Node::CTeq(Node::CTcmp(s.distu + s.weight, s.distv), -1);
+
+            heapOps[j] = 3;
+            heapOps[j] = Node::conditional_select(1, heapOps[j], !s.innerloop);
+            heapOps[j] = Node::conditional_select(4, heapOps[j], relax);
+            heapV[j] = Node::conditional_select(s.v - 1, s.u, relax);
+            heapDist[j] = Node::conditional_select(s.distu + s.weight, s.distu, relax);
+        }
+        ecall_execute_heap_operations(k, heapV.data(), heapDist.data(), heapOps.data());
+
+        for (int j = 0; j < k; j++) {
+            SSSPInstance& s = state[j];
+            s.u = Node::conditional_select(heapV[j], s.u, !s.innerloop);
+            s.distu = Node::conditional_select(heapDist[j], s.distu, !s.innerloop);
+            s.cnt = Node::conditional_select(s.cnt + 1, s.cnt, s.innerloop);
+            s.u = Node::conditional_select(s.u + 1, s.u, !s.innerloop && !Node::CTeq(s.u, -1));
+            int nextCnt = Node::conditional_select(s.cnt, 1, s.innerloop);
+            accessKeys[j] = graphKey(VERTEX_KEY, Node::conditional_select(s.u, 0, !s.innerloop && !Node::CTeq(s.u, -1)), j + 1);
+            accessKeys[k + j] = graphKey(OUT_EDGE_KEY, s.u, nextCnt);
+        }
+        multiAccessOMAP(accessKeys.data(), accessValues.data(), readModes.data(), results.data(), 2 * k);
+
+        for (int j = 0; j < k; j++) {
+            SSSPInstance& s = state[j];
+            bool check = KV::isEmpty(results[j]) && (s.innerloop || Node::CTeq(s.u, -1));
+            fixed_kv tmp = KV::select(zeroPair, results[j], check);
+            s.curDistU = Node::conditional_select(KV::field(tmp, 0), s.curDistU, !s.innerloop && !Node::CTeq(s.u, -1));
+            s.curDistU = Node::conditional_select(-2, s.curDistU, !s.innerloop && Node::CTeq(s.u, -1));
+            s.cnt = Node::conditional_select(1, s.cnt, !s.innerloop && Node::CTeq(s.curDistU, s.distu));
+            s.dstStr = KV::select(results[k + j], s.dstStr, s.innerloop || Node::CTeq(s.curDistU, s.distu));
+            s.innerloop = (s.innerloop && !KV::isEmpty(s.dstStr)) || (!s.innerloop && Node::CTeq(s.curDistU, s.distu) && !KV::isEmpty(s.dstStr));
+        }
+    }
+
+    for (int j = 0; j < k; j++) {
+        if (distances == NULL) {
+            printf("Source:%d\n", sources[j]);
+        }
+        for (int i = 1; i <= vertexNumber; i++) {
+            string dist = readOMAP(graphKey(VERTEX_KEY, i, j + 1));
+            if (distances != NULL) {
+                distances[j * vertexNumber + i - 1] = std::stoi(dist);
+            } else {
+                printf("Destination:%d  Distance:%s\n", i, dist.c_str());
+            }
+        }
+    }
+}
+
+/**
+ * Oblivious BFS over the $u-k adjacency. The FIFO queue lives in the @i
+ * slots ("v-level") and %v holds the level of every discovered vertex.
+ * Each of the 2V+E iterations does the same five OMAP accesses: pop a queue
+ * slot, read the level of the pending neighbour, write its level and its
+ * queue slot, and read the next adjacency entry. Dummy accesses go to the
+ * @0/%0 scratch keys.
+ */
+void ecall_oblivious_breadth_first_search(int src, int *levels) {
+    if (queryStateDirty) {
+        ecall_reset_query_state();
+    }
+    queryStateDirty = true;
+    ocall_start_timer(34);
+
+    readWriteOMAP(graphKey(LEVEL_KEY, src), "0");
+    readWriteOMAP(graphKey(QUEUE_KEY, 1), to_string(src) + "-0");
+
+    bool innerloop = false;
+    int head = 1, tail = 2, u = 0, levelU = 0, v = 0, cnt = 1;
+    string dstStr = "", tmp = "";
+
+    for (int i = 0; i < (2 * vertexNumber + edgeNumber); i++) {
+        if (i % 1000 == 0) {
+            LOG_DEBUG("obfs: %d/%d\n", i, 2 * vertexNumber + edgeNumber);
+        }
+        bool pop = !innerloop && Node::CTeq(Node::CTcmp(head, tail), -1);
+        tmp = readOMAP(graphKey(QUEUE_KEY, Node::conditional_select(head, 0, pop)));
+        tmp = CTString(tmp, "0-0", pop);
+        auto parts = splitData(tmp, "-");
+        u = Node::conditional_select(std::stoi(parts[0]), u, pop);
+        levelU = Node::conditional_select(std::stoi(parts[1]), levelU, pop);
+        head = Node::conditional_select(head + 1, head, pop);
+        cnt = Node::conditional_select(1, cnt, !innerloop);
+
+        parts = splitData(CTString(dstStr, "0-0", innerloop), "-");
+        v = Node::conditional_select(std::stoi(parts[0]), 0, innerloop);
+        tmp = readOMAP(graphKey(LEVEL_KEY, v));
+        bool discover = innerloop && Node::CTeq(tmp.length(), 0);
+        string level = to_string(levelU + 1);
+        readWriteOMAP(graphKey(LEVEL_KEY, Node::conditional_select(v, 0, discover)), CTString(level, "", discover));
+        readWriteOMAP(graphKey(QUEUE_KEY, Node::conditional_select(tail, 0, discover)), CTString(to_string(v) + "-" + level, "0-0", discover));
+        tail = Node::conditional_select(tail + 1, tail, discover);
+        cnt = Node::conditional_select(cnt + 1, cnt, innerloop);
+
+        dstStr = readOMAP(graphKey(OUT_EDGE_KEY, u, cnt));
+        innerloop = (pop || innerloop) && !Node::CTeq(dstStr.length(), 0);
+    }
+
+    for (int i = 1; i <= vertexNumber; i++) {
+        tmp = readOMAP(graphKey(LEVEL_KEY, i));
+        int level = tmp.length() == 0 ? MY_MAX : std::stoi(tmp);
+        if (levels != NULL) {
+            levels[i - 1] = level;
+        } else {
+            printf("Destination:%d  Distance:%d\n", i, level);
+        }
+    }
+}
+
+/**
+ * Level-synchronous BFS that runs BFSLevelProgram on the padded edge list
+ * in enclave memory instead of the OMAP. With rounds = 0 it stops at the
+ * first round without changes, which reveals the eccentricity of src;
+ * V - 1 rounds hide it.
+ */
+void ecall_oblivious_breadth_first_search_batched(int src, int *levels, int rounds) {
+    ocall_start_timer(34);
+    BFSLevelProgram program = {src, MY_MAX};
+    VertexProgramEngine<BFSLevelProgram> engine(program, graphEdges, maximumPad, edgeStoreSingleBlockSize, vertexNumber);
+    engine.run(Node::conditional_select(rounds, vertexNumber - 1, rounds > 0), rounds == 0);
+    vector<int> result = engine.values();
+    for (int i = 1; i <= vertexNumber; i++) {
+        if (levels != NULL) {
+            levels[i - 1] = result[i - 1];
+        } else {
+            printf("Destination:%d  Distance:%d\n", i, result[i - 1]);
+        }
+    }
+}
+
+/**
+ * Bellman-Ford SSSP as sort-scan rounds of BellmanFordProgram over the
+ * padded edge list: no ORAM or heap accesses, only oblivious sorts and
+ * linear scans. rounds > 0 runs exactly that many rounds, which is exact
+ * from V - 1 rounds on; with rounds = 0 it stops at the first round
+ * without changes, which reveals the hop depth of the shortest path tree.
+ */
+void ecall_oblivious_bellman_ford_shortest_path(int src, int *distances, int rounds) {
+    ocall_start_timer(34);
+    BellmanFordProgram program = {src, MY_MAX};
+    VertexProgramEngine<BellmanFordProgram> engine(program, graphEdges, maximumPad, edgeStoreSingleBlockSize, vertexNumber);
+    engine.run(Node::conditional_select(rounds, vertexNumber - 1, rounds > 0), rounds == 0);
+    vector<int> result = engine.values();
+    for (int i = 1; i <= vertexNumber; i++) {
+        if (distances != NULL) {
+            distances[i - 1] = result[i - 1];
+        } else {
+            printf("Destination:%d  Distance:%d\n", i, result[i - 1]);
+        }
+    }
+}
+
+/**
+ * (key, value) table entry (isQuery = 0) or lookup request for key
+ * (isQuery = 1, pos = index of the request) of obliviousLookup.
+ */
+struct LookupRecord {
+    int key;
+    int pos;
+    int value;
+    int isQuery;
+};
+
+/**
+ * Replaces every key in queries by the value stored for it in table, or by
+ * missing if table has no such key. Table keys must be unique; entries with
+ * a negative key are ignored. Two oblivious sorts over table and queries.
+ */
+void obliviousLookup(const vector<pair<int, int> >& table, vector<int>& queries, int missing) {
+    vector<LookupRecord> records;
+    records.reserve(table.size() + queries.size());
+    for (auto& entry : table) {
+        records.push_back({entry.first, 0, entry.second, 0});
+    }
+    for (int i = 0; i < (int) queries.size(); i++) {
+        records.push_back({queries[i], i, missing, 1});
+    }
+    GraphObliviousOperations::bitonicSort(&records, [](const LookupRecord & r) {
+        return ((unsigned long long) (unsigned int) r.key << 1) | (unsigned long long) r.isQuery;
+    });
+    int prevKey = -1, carry = missing;
+    for (auto& r : records) {
+        bool found = Node::CTeq(r.key, prevKey) && !Node::CTeq(r.key, -1);
+        carry = Node::conditional_select(r.value, carry, !r.isQuery);
+        prevKey = Node::conditional_select(r.key, prevKey, !r.isQuery);
+        r.value = Node::conditional_select(Node::conditional_select(carry, missing, found), r.value, r.isQuery);
+    }
+    GraphObliviousOperations::bitonicSort(&records, [](const LookupRecord & r) {
+        return ((unsigned long long) r.isQuery << 32) | (unsigned long long) (unsigned int) r.pos;
+    });
+    for (int i = 0; i < (int) queries.size(); i++) {
+        queries[i] = records[table.size() + i].value;
+    }
+}
+
+/**
+ * (v, labels[v - 1]) lookup table over the vertices
+ */
+vector<pair<int, int> > labelTable(const vector<int>& labels) {
+    vector<pair<int, int> > table(labels.size());
+    for (int v = 1; v <= (int) labels.size(); v++) {
+        table[v - 1] = make_pair(v, labels[v - 1]);
+    }
+    return table;
+}
+
+/**
+ * Points every vertex at the root of its label tree with ceil(log2 V)
+ * oblivious jumps labels[v] = labels[labels[v]].
+ */
+void pointerJump(vector<int>& labels) {
+    int jumps = (int) ceil(log2(max((int) labels.size(), 2)));
+    for (int j = 0; j < jumps; j++) {
+        vector<int> next(labels);
+        obliviousLookup(labelTable(labels), next, 0);
+        labels = next;
+    }
+}
+
+/**
+ * Edge of the spanning forest computation. rank is the position of the
+ * edge in (weight, input position) order and breaks weight ties.
+ */
+struct MSTEdge {
+    int src_id;
+    int dst_id;
+    int weight;
+    int rank;
+    int inMST;
+};
+
+/**
+ * Cheapest edge candidate of the component comp, for one direction of an
+ * undirected edge.
+ */
+struct MSTCandidate {
+    int comp;
+    int other;
+    int rank;
+    int valid;
+    int selected;
+    int side;
+};
+
+/**
+ * Oblivious Boruvka over the padded edge list, with edges taken as
+ * undirected. Each of the fixed ceil(log2 V) rounds lets every component
+ * pick its cheapest outgoing edge by sorting candidates by (component,
+ * rank), hooks the component to the other side (mutual picks keep the
+ * smaller root), and compresses the labels by pointer jumping. All
+ * lookups go through oblivious sorts, so the access pattern only depends on
+ * V and the padded edge count. The final component label of every vertex
+ * is written back to its /v key.
+ */
+void ecall_oblivious_minimum_spanning_tree() {
+    ocall_start_timer(34);
+    int edgeSlots = maximumPad;
+    vector<MSTEdge> edges(edgeSlots);
+    for (int i = 0; i < edgeSlots; i++) {
+        GraphNode edge;
+        std::memcpy(&edge, graphEdges + i * edgeStoreSingleBlockSize, sizeof (GraphNode));
+        edges[i] = {edge.src_id, edge.dst_id, edge.weight, i, 0};
+    }
+    GraphObliviousOperations::bitonicSort(&edges, [](const MSTEdge & e) {
+        return ((unsigned long long) (unsigned int) e.weight << 32) | (unsigned long long) (unsigned int) e.rank;
+    });
+    for (int i = 0; i < edgeSlots; i++) {
+        edges[i].rank = i;
+    }
+
+    vector<int> labels(vertexNumber);
+    for (int v = 1; v <= vertexNumber; v++) {
+        labels[v - 1] = v;
+    }
+    int rounds = Node::conditional_select((int) ceil(log2(max(vertexNumber, 2))), 0, vertexNumber > 1);
+
+    vector<MSTCandidate> candidates(2 * edgeSlots);
+    for (int round = 0; round < rounds; round++) {
+        LOG_DEBUG("omst: round %d/%d\n", round + 1, rounds);
+        vector<int> ends(2 * edgeSlots);
+        for (int i = 0; i < edgeSlots; i++) {
+            ends[i] = edges[i].src_id;
+            ends[edgeSlots + i] = edges[i].dst_id;
+        }
+        obliviousLookup(labelTable(labels), ends, -1);
+
+        for (int i = 0; i < edgeSlots; i++) {
+            int la = ends[i], lb = ends[edgeSlots + i];
+            int valid = !Node::CTeq(la, -1) && !Node::CTeq(lb, -1) && !Node::CTeq(la, lb);
+            candidates[2 * i] = {la, lb, i, valid, 0, 0};
+            candidates[2 * i + 1] = {lb, la, i, valid, 0, 1};
+        }
+        GraphObliviousOperations::bitonicSort(&candidates, [](const MSTCandidate & c) {
+            return ((unsigned long long) (unsigned int) c.comp << 32) | (unsigned long long) (unsigned int) c.rank
+                    | ((unsigned long long) (1 - c.valid) << 31);
+        });
+        int prev = -1;
+        vector<pair<int, int> > hooks(candidates.size());
+        for (int i = 0; i < (int) candidates.size(); i++) {
+            MSTCandidate& c = candidates[i];
+            c.selected = c.valid && !Node::CTeq(c.comp, prev);
+            prev = c.comp;
+            hooks[i] = make_pair(Node::conditional_select(c.comp, -1, c.selected), c.other);
+        }
+
+        vector<int> parents(vertexNumber);
+        for (int v = 1; v <= vertexNumber; v++) {
+            parents[v - 1] = v;
+        }
+        obliviousLookup(hooks, parents, 0);
+        for (int v = 1; v <= vertexNumber; v++) {
+            labels[v - 1] = Node::conditional_select(labels[v - 1], parents[v - 1], Node::CTeq(parents[v - 1], 0));
+        }
+
+        // two roots that picked each other: the smaller one stays a root
+        vector<int> grand(labels);
+        obliviousLookup(labelTable(labels), grand, 0);
+        for (int v = 1; v <= vertexNumber; v++) {
+            bool mutual = Node::CTeq(grand[v - 1], v) && Node::CTeq(Node::CTcmp(v, labels[v - 1]), -1);
+            labels[v - 1] = Node::conditional_select(v, labels[v - 1], mutual);
+        }
+        pointerJump(labels);
+
+        GraphObliviousOperations::bitonicSort(&candidates, [](const MSTCandidate & c) {
+            return ((unsigned long long) (unsigned int) c.rank << 1) | (unsigned long long) c.side;
+        });
+        for (int i = 0; i < edgeSlots; i++) {
+            edges[i].inMST |= candidates[2 * i].selected | candidates[2 * i + 1].selected;
+        }
+    }
+
+    long long totalWeight = 0;
+    int treeEdges = 0;
+    for (int i = 0; i < edgeSlots; i++) {
+        totalWeight += Node::conditional_select((long long) edges[i].weight, 0LL, edges[i].inMST);
+        treeEdges += edges[i].inMST;
+    }
+    for (int v = 1; v <= vertexNumber; v++) {
+        readWriteOMAP(graphKey(VERTEX_KEY, v), to_string(labels[v - 1]));
     }
-}
\ No newline at end of file
+    printf("MST Weight:%lld  Edges:%d\n", totalWeight, treeEdges);
+    for (int v = 1; v <= vertexNumber; v++) {
+        printf("Vertex:%d  Component:%s\n", v, readOMAP(graphKey(VERTEX_KEY, v)).c_str());
+    }
+}
+
+/**
+ * Edge of the components computation, reduced to the proposal "root
+ * target can hook under the smaller root value".
+ */
+struct HookProposal {
+    int target;
+    int value;
+};
+
+/**
+ * Oblivious connected components (edges taken as undirected) over the
+ * padded edge list. Every round looks up the labels of both ends of all
+ * edges, lets each root hook under the smallest neighbouring root that is
+ * smaller than itself (min found by sorting the proposals), and compresses
+ * the labels by pointer jumping. Hooks only go to smaller labels, so no
+ * cycles appear. With rounds = 0 it stops after the first round without
+ * hooks, which reveals the round count; otherwise it runs exactly rounds.
+ * @return the number of components
+ */
+int ecall_oblivious_connected_components(int *components, int rounds) {
+    ocall_start_timer(34);
+    vector<int> srcs(maximumPad), dsts(maximumPad);
+    for (int i = 0; i < maximumPad; i++) {
+        GraphNode edge;
+        std::memcpy(&edge, graphEdges + i * edgeStoreSingleBlockSize, sizeof (GraphNode));
+        srcs[i] = edge.src_id;
+        dsts[i] = edge.dst_id;
+    }
+    vector<int> labels(vertexNumber);
+    for (int v = 1; v <= vertexNumber; v++) {
+        labels[v - 1] = v;
+    }
+
+    vector<HookProposal> proposals(maximumPad);
+    int maxRounds = Node::conditional_select(rounds, vertexNumber, rounds > 0);
+    for (int round = 0; round < maxRounds; round++) {
+        LOG_DEBUG("occ: round %d\n", round + 1);
+        vector<int> ends(srcs);
+        ends.insert(ends.end(), dsts.begin(), dsts.end());
+        obliviousLookup(labelTable(labels), ends, -1);
+
+        for (int i = 0; i < maximumPad; i++) {
+            int la = ends[i], lb = ends[maximumPad + i];
+            bool valid = !Node::CTeq(la, -1) && !Node::CTeq(lb, -1) && !Node::CTeq(la, lb);
+            bool less = Node::CTeq(Node::CTcmp(la, lb), -1);
+            proposals[i].target = Node::conditional_select(Node::conditional_select(lb, la, less), -1, valid);
+            proposals[i].value = Node::conditional_select(la, lb, less);
+        }
+        GraphObliviousOperations::bitonicSort(&proposals, [](const HookProposal & p) {
+            return ((unsigned long long) (unsigned int) p.target << 32) | (unsigned long long) (unsigned int) p.value;
+        });
+        int prev = -1, hooked = 0;
+        vector<pair<int, int> > hooks(maximumPad);
+        for (int i = 0; i < maximumPad; i++) {
+            bool first = !Node::CTeq(proposals[i].target, prev);
+            prev = proposals[i].target;
+            hooks[i] = make_pair(Node::conditional_select(proposals[i].target, -1, first), proposals[i].value);
+            hooked |= first && !Node::CTeq(proposals[i].target, -1);
+        }
+
+        vector<int> parents(vertexNumber);
+        for (int v = 1; v <= vertexNumber; v++) {
+            parents[v - 1] = v;
+        }
+        obliviousLookup(hooks, parents, 0);
+        for (int v = 1; v <= vertexNumber; v++) {
+            labels[v - 1] = Node::conditional_select(labels[v - 1], parents[v - 1], Node::CTeq(parents[v - 1], 0));
+        }
+        pointerJump(labels);
+        if (rounds == 0 && !hooked) {
+            break;
+        }
+    }
+
+    int count = 0;
+    for (int v = 1; v <= vertexNumber; v++) {
+        count += Node::CTeq(labels[v - 1], v);
+        if (components != NULL) {
+            components[v - 1] = labels[v - 1];
+        }
+    }
+    if (components == NULL) {
+        printf("Components:%d\n", count);
+        for (int v = 1; v <= vertexNumber; v++) {
+            printf("Vertex:%d  Component:%d\n", v, labels[v - 1]);
+        }
+    }
+    return count;
+}
+
+/**
+ * Fixed-iteration oblivious PageRank on the padded edge list
+ */
+void ecall_oblivious_pagerank(int iterations, double *ranks) {
+    ocall_start_timer(34);
+    PageRankProgram program = {vertexNumber, 0.85};
+    VertexProgramEngine<PageRankProgram> engine(program, graphEdges, maximumPad, edgeStoreSingleBlockSize, vertexNumber);
+    engine.run(iterations);
+    vector<double> result = engine.values();
+    for (int v = 1; v <= vertexNumber; v++) {
+        if (ranks != NULL) {
+            ranks[v - 1] = result[v - 1];
+        } else {
+            printf("Vertex:%d  Rank:%.6f\n", v, result[v - 1]);
+        }
+    }
+}
+
+/**
+ * Oblivious minimum label propagation over undirected edges. With
+ * iterations = 0 it runs V rounds, enough for any diameter. With
+ * iterations < 0 it runs until stable (at most V rounds), which reveals
+ * the largest component diameter.
+ */
+void ecall_oblivious_label_propagation(int iterations, int *labels) {
+    ocall_start_timer(34);
+    LabelPropagationProgram program = {MY_MAX};
+    VertexProgramEngine<LabelPropagationProgram> engine(program, graphEdges, maximumPad, edgeStoreSingleBlockSize, vertexNumber, true);
+    int rounds = engine.run(Node::conditional_select(iterations, vertexNumber, iterations > 0), iterations < 0);
+    vector<int> result = engine.values();
+    if (labels == NULL) {
+        printf("Label propagation rounds:%d\n", rounds);
+    }
+    for (int v = 1; v <= vertexNumber; v++) {
+        if (labels != NULL) {
+            labels[v - 1] = result[v - 1];
+        } else {
+            printf("Vertex:%d  Component:%d\n", v, result[v - 1]);
+        }
+    }
+}
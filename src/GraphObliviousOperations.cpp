@@ -0,0 +1,30 @@
+#include "GraphObliviousOperations.h"
+#include <algorithm>
+
+int GraphObliviousOperations::sortThreads = 1;
+
+GraphObliviousOperations::GraphObliviousOperations() {
+}
+
+GraphObliviousOperations::~GraphObliviousOperations() {
+}
+
+int GraphObliviousOperations::CTcmp(unsigned long long lhs, unsigned long long rhs) {
+    unsigned __int128 overflowing_iff_lt = (unsigned __int128) lhs - (unsigned __int128) rhs;
+    unsigned __int128 overflowing_iff_gt = (unsigned __int128) rhs - (unsigned __int128) lhs;
+    int is_less_than = (int) -(overflowing_iff_lt >> 127); // -1 if self < other, 0 otherwise.
+    int is_greater_than = (int) (overflowing_iff_gt >> 127); // 1 if self > other, 0 otherwise.
+    return is_less_than + is_greater_than;
+}
+
+int GraphObliviousOperations::greatest_power_of_two_less_than(int n) {
+    int k = 1;
+    while (k > 0 && k < n) {
+        k = k << 1;
+    }
+    return k >> 1;
+}
+
+void GraphObliviousOperations::setSortThreads(int threads) {
+    sortThreads = max(threads, 1);
+}
@@ -1,4 +1,5 @@
 #include "HeapObliviousOperations.h"
+#include <algorithm>
 
 HeapObliviousOperations::HeapObliviousOperations() {
 }
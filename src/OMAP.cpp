@@ -1,27 +1,28 @@
 #include "OMAP.h"
+#include "Log.h"
 using namespace std;
 
 OMAP::OMAP(int maxSize, bool isEmptyOMAP) {
     treeHandler = new AVLTree(maxSize, isEmptyOMAP);
     rootKey = 0;
-    std::cout << "init 1, rootKey: " << rootKey.getValue() << std::endl;
+    LOG_INFO("init 1, rootKey: %lld\n", rootKey.getValue());
 }
 
 OMAP::OMAP(int maxSize, map<Bid, string>* pairs, map<unsigned long long, unsigned long long>* permutation) {
     treeHandler = new AVLTree(maxSize, rootKey, rootPos, pairs, permutation);
-    std::cout << "init 2, rootKey: " << rootKey.getValue() << std::endl;
+    LOG_INFO("init 2, rootKey: %lld\n", rootKey.getValue());
 }
 
 OMAP::OMAP(int maxSize, Bid rootBid, long long rootPos) {
     treeHandler = new AVLTree(maxSize, false);
     this->rootKey = rootBid;
     this->rootPos = rootPos;
-    std::cout << "init 3, rootKey: " << rootKey.getValue() << std::endl;
+    LOG_INFO("init 3, rootKey: %lld\n", rootKey.getValue());
 }
 
 OMAP::OMAP(int maxSize, long long initialSize) {
     treeHandler = new AVLTree(maxSize, initialSize, this->rootKey, this->rootPos);
-    std::cout << "init 4, rootKey: " << rootKey.getValue() << ", rootPos: " << this->rootPos << std::endl;
+    LOG_INFO("init 4, rootKey: %lld, rootPos: %llu\n", rootKey.getValue(), this->rootPos);
 }
 
 OMAP::~OMAP() {
@@ -47,13 +48,13 @@ void OMAP::insert(Bid omapKey, string value) {
     treeHandler->totheight = 0;
     int height;
     treeHandler->startOperation(false);
-    std::cout << "rootKey: " << rootKey.getValue() << std::endl;
+    LOG_TRACE("rootKey: %lld\n", rootKey.getValue());
     if (rootKey == 0) {
         rootKey = treeHandler->insert(0, rootPos, omapKey, value, height, omapKey, false);
     } else {
         rootKey = treeHandler->insert(rootKey, rootPos, omapKey, value, height, omapKey, false);
     }
-    std::cout << "rootKey: " << rootKey.getValue() << std::endl;
+    LOG_TRACE("rootKey: %lld\n", rootKey.getValue());
     treeHandler->finishOperation();
 }
 
@@ -209,4 +210,75 @@ string OMAP::atomicReadAndSetDist(Bid mapKey, string newValue) {
     rootPos = node->pos;
     delete node;
     return res;
-}
\ No newline at end of file
+}
+/**
+ * Appends the trusted OMAP state (root, node counter and ORAM stash) to a
+ * snapshot. The buckets themselves are persisted from the untrusted store.
+ */
+void OMAP::checkpoint(block& state) {
+    append_bytes(state, rootKey);
+    append_bytes(state, rootPos);
+    append_bytes(state, treeHandler->index);
+    treeHandler->oram->checkpoint(state);
+}
+
+/**
+ * Rebuilds an OMAP over an already restored store from its checkpointed
+ * trusted state, without touching any bucket.
+ */
+OMAP* OMAP::restore(int maxSize, const byte_t*& cursor) {
+    Bid rootBid;
+    unsigned long long pos;
+    read_bytes(cursor, rootBid);
+    read_bytes(cursor, pos);
+    OMAP* map = new OMAP(maxSize, rootBid, pos);
+    read_bytes(cursor, map->treeHandler->index);
+    map->treeHandler->oram->restore(cursor);
+    return map;
+}
+
+/**
+ * Sets the value of every key starting with prefix, with one linear pass
+ * over the ORAM instead of one tree traversal per key.
+ */
+void OMAP::rewritePrefix(string prefix, string value) {
+    std::array<byte_t, 16> newValue;
+    newValue.fill(0);
+    std::copy(value.begin(), value.end(), newValue.begin());
+    treeHandler->oram->scanAndRewrite([&](Node * node) {
+        bool match = !node->isDummy && !node->key.isZero();
+        for (unsigned int i = 0; i < prefix.size(); i++) {
+            match = match && Node::CTeq((int) node->key.id[i], (int) (byte_t) prefix[i]);
+        }
+        for (int k = 0; k < node->value.size(); k++) {
+            node->value[k] = Node::conditional_select(newValue[k], node->value[k], match);
+        }
+    });
+}
+
+/**
+ * Fused access to several keys in one lockstep traversal: key i is read
+ * and its value is then updated with values[i] as writeModes[i]
+ * (ValueWriteMode) says. Returns the values from before the updates. The
+ * trace only depends on the number of keys; keys that are written must be
+ * distinct.
+ */
+vector<string> OMAP::multiAccess(const vector<Bid>& keys, const vector<string>& values, const vector<int>& writeModes) {
+    if (rootKey == 0) {
+        return vector<string>(keys.size());
+    }
+    vector<std::array<byte_t, 16> > newValues(values.size());
+    for (unsigned int i = 0; i < values.size(); i++) {
+        newValues[i].fill(0);
+        std::copy(values[i].begin(), values[i].end(), newValues[i].begin());
+    }
+    treeHandler->startOperation(false);
+    Node* node = new Node();
+    node->key = rootKey;
+    node->pos = rootPos;
+    vector<string> res = treeHandler->batchSearch(node, keys, &newValues, &writeModes);
+    rootPos = node->pos;
+    delete node;
+    treeHandler->finishOperation();
+    return res;
+}
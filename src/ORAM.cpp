@@ -11,6 +11,8 @@
 #include "ObliviousOperations.h"
 #include "ORAMEnclaveInterface.h"
 #include "RAMStoreEnclaveInterface.h"
+#include "WriteBack.h"
+#include "Log.h"
 #include <algorithm>
 #include <stdlib.h>
 #include <cstdio>
@@ -38,6 +40,7 @@ void check_memory3(string text) {
 }
 
 ORAM::ORAM(long long maxSize, bool simulation, bool isEmptyMap) : gen(rd()) {
+    WriteBack::RamStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = uniform_int_distribution<long long>(0, maxOfRandom - 1);
@@ -45,12 +48,12 @@ ORAM::ORAM(long long maxSize, bool simulation, bool isEmptyMap) : gen(rd()) {
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
     stash.preAllocate(PERMANENT_STASH_SIZE * 4);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n", (int)depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n", (int)depth);
 
     nextDummyCounter = INF;
     blockSize = sizeof (Node); // B    
-    printf("block size is:%d\n", (int)blockSize);
+    LOG_INFO("block size is:%d\n", (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
     storeBlockSize = (size_t) Z * (size_t)(blockSize);
     plaintext_size = (blockSize) * Z;
@@ -66,7 +69,7 @@ ORAM::ORAM(long long maxSize, bool simulation, bool isEmptyMap) : gen(rd()) {
 
     maxHeightOfAVLTree = (int) floor(log2(blockCount)) + 1;
 
-    printf("Initializing ORAM Buckets\n");
+    LOG_INFO("Initializing ORAM Buckets\n");
     Bucket bucket;
     for (int z = 0; z < Z; z++) {
         bucket[z].id = 0;
@@ -90,16 +93,18 @@ ORAM::ORAM(long long maxSize, bool simulation, bool isEmptyMap) : gen(rd()) {
         stash.insert(dummy);
         nextDummyCounter++;
     }
-    printf("End of Initialization\n");
+    LOG_INFO("End of Initialization\n");
 }
 
 ORAM::~ORAM() {
+    AwaitPrefetch();
+    WriteBack::RamStore().drain();
 }
 
 void ORAM::InitializeBucketsOneByOne() {
     for (long long i = 0; i < bucketCount; i++) {
         if (i % 10000 == 0) {
-            printf("%d/%d\n", (int)i, (int)bucketCount);
+            LOG_INFO("%d/%d\n", (int)i, (int)bucketCount);
         }
         Bucket bucket;
         for (int z = 0; z < Z; z++) {
@@ -115,7 +120,7 @@ void ORAM::InitializeBucketsInBatch() {
 
     for (unsigned int j = 0; j <= bucketCount / batchSize; j++) {
         if (j % 10 == 0) {
-            printf("%d/%d\n", j, (int)(bucketCount / batchSize));
+            LOG_INFO("%d/%d\n", j, (int)(bucketCount / batchSize));
         }
         char* tmp = new char[batchSize * storeBlockSize];
         vector<long long> indexes;
@@ -149,7 +154,7 @@ void ORAM::InitializeORAMBuckets() {
 
 
     time = ocall_stop_timer(687);
-    printf("ORAM Initialization Time:%f\n", time);
+    LOG_INFO("ORAM Initialization Time:%f\n", time);
 }
 
 void ORAM::WriteBucket(long long index, Bucket bucket) {
@@ -212,7 +217,9 @@ void ORAM::ReadBuckets(vector<long long> indexes) {
     } else {
         size_t readSize;
         char* tmp = new char[indexes.size() * storeBlockSize];
-        readSize = ocall_nread_ramStore(indexes.size(), indexes.data(), tmp, indexes.size() * storeBlockSize);
+        readSize = WriteBack::RamStore().read(indexes, tmp, [&]() {
+            return ocall_nread_ramStore(indexes.size(), indexes.data(), tmp, indexes.size() * storeBlockSize);
+        });
         for (unsigned int i = 0; i < indexes.size(); i++) {
             block buffer(tmp + i*readSize, tmp + (i + 1) * readSize);
             Bucket bucket = DeserialiseBucket(buffer);
@@ -245,31 +252,29 @@ void ORAM::WriteBuckets(vector<long long> indexes, vector<Bucket> buckets) {
 }
 
 void ORAM::EvictBuckets() {
+    AwaitPrefetch();
     if (!shutdownEvictBucket) {
-        unordered_map<long long, Bucket>::iterator it = virtualStorage.begin();
         if (useLocalRamStore) {
             for (auto item : virtualStorage) {
                 block b = SerialiseBucket(item.second);
                 localStore->Write(item.first, b);
             }
         } else {
-            for (unsigned int j = 0; j <= virtualStorage.size() / 10000; j++) {
-                char* tmp = new char[10000 * storeBlockSize];
-                vector<long long> indexes;
-                size_t cipherSize = 0;
-                for (int i = 0; i < min((int) (virtualStorage.size() - j * 10000), 10000); i++) {
-                    block b = SerialiseBucket(it->second);
-                    indexes.push_back(it->first);
-                    std::memcpy(tmp + i * b.size(), b.data(), b.size());
-                    cipherSize = b.size();
-                    it++;
-                }
-                if (min((int) (virtualStorage.size() - j * 10000), 10000) != 0) {
-                    ocall_nwrite_ramStore(min((int) (virtualStorage.size() - j * 10000), 10000), indexes.data(), (const char*) tmp, cipherSize * min((int) (virtualStorage.size() - j * 10000), 10000));
+            vector<long long> indexes;
+            vector<char> data;
+            data.reserve(virtualStorage.size() * storeBlockSize);
+            size_t cipherSize = 0;
+            for (const auto& item : virtualStorage) {
+                block b = SerialiseBucket(item.second);
+                indexes.push_back(item.first);
+                data.insert(data.end(), b.begin(), b.end());
+                cipherSize = b.size();
+                // a prefetched copy of this bucket is stale from now on
+                if (prefetchSlots.count(item.first) != 0) {
+                    std::memcpy(prefetchBuffer.data() + prefetchSlots[item.first] * prefetchReadSize, b.data(), b.size());
                 }
-                delete tmp;
-                indexes.clear();
             }
+            WriteBack::RamStore().push(std::move(indexes), std::move(data), cipherSize);
         }
         virtualStorage.clear();
     }
@@ -299,7 +304,22 @@ void ORAM::FetchPath(long long leaf) {
         }
     }
 
-    ReadBuckets(nodesIndex);
+    // buckets the previous access prefetched skip the store read
+    AwaitPrefetch();
+    vector<long long> readIndexes;
+    for (long long index : nodesIndex) {
+        if (prefetchSlots.count(index) == 0) {
+            readIndexes.push_back(index);
+            continue;
+        }
+        char* begin = prefetchBuffer.data() + prefetchSlots[index] * prefetchReadSize;
+        Bucket bucket = DeserialiseBucket(block(begin, begin + prefetchReadSize));
+        if (!evictBuckets) {
+            virtualStorage[index] = bucket;
+        }
+    }
+    prefetchSlots.clear();
+    ReadBuckets(readIndexes);
 
     for (unsigned int i = 0; i < existingIndexes.size(); i++) {
         Bucket bucket = virtualStorage[existingIndexes[i]];
@@ -502,7 +522,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
     accessCounter++;
 
 
-    unsigned long long newPos = RandomPath();
+    unsigned long long newPos = nextFetchLeaf();
     unsigned long long fetchPos = Node::conditional_select(newPos, lastLeaf, isDummy);
 
     FetchPath(fetchPos);
@@ -553,11 +573,30 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
 
     }
 
+    PrefetchNextLeaf(res, targetNode, isDummy);
     evict(evictBuckets);
     return res;
 }
 
-Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, std::array< byte_t, 16> newVec) {
+/**
+ * Value of a decimal string value; parsing stops at the first non-digit
+ */
+long long ORAM::decimalValue(const std::array< byte_t, 16>& value) {
+    long long result = 0;
+    bool done = false;
+    for (int i = 0; i < value.size(); i++) {
+        bool digit = !Node::CTeq(Node::CTcmp(value[i], '0'), -1) && !Node::CTeq(Node::CTcmp(value[i], '9'), 1);
+        done = done || !digit;
+        result = Node::conditional_select(result * 10 + (value[i] - '0'), result, !done);
+    }
+    return result;
+}
+
+/**
+ * @param writeMode one of ValueWriteMode; the returned node holds the value
+ * from before the write
+ */
+Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long newLeaf, bool isDummy, unsigned long long newChildPos, Bid targetNode, std::array< byte_t, 16> newVec, int writeMode) {
     if (bid == 0) {
         printf("bid is 0 dummy is:%d\n", isDummy ? 1 : 0);
         throw runtime_error("Node id is not set");
@@ -565,7 +604,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
     accessCounter++;
 
 
-    unsigned long long newPos = RandomPath();
+    unsigned long long newPos = nextFetchLeaf();
     unsigned long long fetchPos = Node::conditional_select(newPos, lastLeaf, isDummy);
 
     FetchPath(fetchPos);
@@ -614,12 +653,17 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
         //these 2 should be after result set(here is correct)
         node->leftPos = Node::conditional_select(newChildPos, node->leftPos, !isDummy && match && leftChild);
         node->rightPos = Node::conditional_select(newChildPos, node->rightPos, !isDummy && match && rightChild);
+        bool write = Node::CTeq(writeMode, WRITE_ALWAYS);
+        if (writeMode == WRITE_IF_LESS) {
+            write = Node::CTeq(Node::CTcmp(decimalValue(newVec), decimalValue(node->value)), -1);
+        }
         for (int k = 0; k < node->value.size(); k++) {
-            node->value[k] = Node::conditional_select(newVec[k], node->value[k], curNodeIsTarget && match);
+            node->value[k] = Node::conditional_select(newVec[k], node->value[k], curNodeIsTarget && match && write);
         }
 
     }
 
+    PrefetchNextLeaf(res, targetNode, isDummy);
     evict(evictBuckets);
     return res;
 }
@@ -647,7 +691,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
     accessCounter++;
 
 
-    unsigned long long newPos = RandomPath();
+    unsigned long long newPos = nextFetchLeaf();
     unsigned long long fetchPos = Node::conditional_select(newPos, lastLeaf, isDummy);
 
     FetchPath(fetchPos);
@@ -718,6 +762,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
 
     }
 
+    PrefetchNextLeaf(res, targetNode, isDummy);
     evict(evictBuckets);
     return res;
 }
@@ -730,7 +775,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
     accessCounter++;
 
 
-    unsigned long long newPos = RandomPath();
+    unsigned long long newPos = nextFetchLeaf();
     unsigned long long fetchPos = Node::conditional_select(newPos, lastLeaf, isDummy);
 
     FetchPath(fetchPos);
@@ -801,6 +846,7 @@ Node* ORAM::ReadWrite(Bid bid, unsigned long long lastLeaf, unsigned long long n
 
     }
 
+    PrefetchNextLeaf(res, targetNode, isDummy);
     evict(evictBuckets);
     return res;
 }
@@ -914,6 +960,200 @@ void ORAM::finilize(bool noDummyOp) {
     }
 }
 
+/**
+ * Appends the trusted ORAM state (stash and eviction counter) to a snapshot.
+ * Cached buckets are written back first so the store image is complete.
+ */
+void ORAM::checkpoint(block& state) {
+    EvictBuckets();
+    WriteBack::RamStore().drain();
+    append_bytes(state, stashCounter);
+    size_t stashSize = stash.nodes.size();
+    append_bytes(state, stashSize);
+    for (Node* node : stash.nodes) {
+        append_bytes(state, *node);
+    }
+}
+
+void ORAM::restore(const byte_t*& cursor) {
+    for (Node* node : stash.nodes) {
+        delete node;
+    }
+    stash.nodes.clear();
+    read_bytes(cursor, stashCounter);
+    size_t stashSize;
+    read_bytes(cursor, stashSize);
+    for (size_t i = 0; i < stashSize; i++) {
+        Node* node = new Node();
+        read_bytes(cursor, *node);
+        stash.insert(node);
+    }
+    AwaitPrefetch();
+    WriteBack::RamStore().drain();
+    prefetchSlots.clear();
+    virtualStorage.clear();
+    nextDummyCounter = INF;
+}
+
+/**
+ * Draws the random leaf that the next search access will fetch if it turns
+ * out to be a dummy access, so a batch of accesses can prefetch it.
+ */
+unsigned long long ORAM::planDummyLeaf() {
+    unsigned long long leaf = RandomPath();
+    plannedLeaves.push_back(leaf);
+    return leaf;
+}
+
+unsigned long long ORAM::nextFetchLeaf() {
+    unsigned long long leaf = RandomPath();
+    if (!plannedLeaves.empty()) {
+        leaf = plannedLeaves.front();
+        plannedLeaves.pop_front();
+    }
+    return leaf;
+}
+
+/**
+ * Reads every bucket on the given paths that is not cached yet with a single
+ * ocall and caches it, so the following accesses to these paths do not go
+ * to the untrusted store one by one. Nothing is added to the stash.
+ */
+void ORAM::prefetchPaths(const vector<unsigned long long>& leaves) {
+    if (useLocalRamStore) {
+        return;
+    }
+    vector<long long> indexes;
+    set<long long> seen;
+    for (unsigned long long leaf : leaves) {
+        long long node = leaf + bucketCount / 2;
+        for (int d = depth; d >= 0; d--) {
+            if (virtualStorage.count(node) == 0 && seen.insert(node).second) {
+                indexes.push_back(node);
+            }
+            node = (node + 1) / 2 - 1;
+        }
+    }
+    if (indexes.size() == 0) {
+        return;
+    }
+    char* tmp = new char[indexes.size() * storeBlockSize];
+    size_t readSize = WriteBack::RamStore().read(indexes, tmp, [&]() {
+        return ocall_nread_ramStore(indexes.size(), indexes.data(), tmp, indexes.size() * storeBlockSize);
+    });
+    for (unsigned int i = 0; i < indexes.size(); i++) {
+        Bucket bucket;
+        for (int z = 0; z < Z; z++) {
+            byte_t* begin = (byte_t*) tmp + i * readSize + z * blockSize;
+            bucket[z].data.assign(begin, begin + blockSize);
+            bucket[z].id = 0;
+        }
+        virtualStorage[indexes[i]] = bucket;
+    }
+    delete[] tmp;
+}
+
+/**
+ * Reads the buckets on the path to leaf that are not cached on
+ * prefetchThread; FetchPath waits for them and takes them from there.
+ */
+void ORAM::StartPrefetch(unsigned long long leaf) {
+    prefetchIndexes.clear();
+    prefetchSlots.clear();
+    long long node = leaf + bucketCount / 2;
+    for (int d = depth; d >= 0; d--) {
+        if (virtualStorage.count(node) == 0) {
+            prefetchSlots[node] = prefetchIndexes.size();
+            prefetchIndexes.push_back(node);
+        }
+        node = (node + 1) / 2 - 1;
+    }
+    if (prefetchIndexes.size() == 0) {
+        return;
+    }
+    prefetchBuffer.resize(prefetchIndexes.size() * storeBlockSize);
+    prefetchReadSize = storeBlockSize;
+    prefetchThread = std::thread([this]() {
+        prefetchReadSize = WriteBack::RamStore().read(prefetchIndexes, prefetchBuffer.data(), [this]() {
+            return ocall_nread_ramStore(prefetchIndexes.size(), prefetchIndexes.data(), prefetchBuffer.data(), prefetchBuffer.size());
+        });
+    });
+}
+
+void ORAM::AwaitPrefetch() {
+    if (prefetchThread.joinable()) {
+        prefetchThread.join();
+    }
+}
+
+/**
+ * Starts the prefetch of the leaf the next search step fetches: the child
+ * of res towards targetNode, or a planned random leaf if that step is a
+ * dummy. Only the leaf the step reads anyway is read, so the store sees
+ * the same paths as without the prefetch, just earlier.
+ */
+void ORAM::PrefetchNextLeaf(Node* res, Bid targetNode, bool isDummy) {
+    bool prefetch = prefetchNextPath && !useLocalRamStore;
+    prefetchNextPath = false;
+    if (!prefetch) {
+        return;
+    }
+    unsigned long long leaf = planDummyLeaf();
+    bool left = Node::CTeq(Bid::CTcmp(res->key, targetNode), 1) && !res->leftID.isZero();
+    bool right = Node::CTeq(Bid::CTcmp(res->key, targetNode), -1) && !res->rightID.isZero();
+    leaf = Node::conditional_select(res->leftPos, leaf, !isDummy && left);
+    leaf = Node::conditional_select(res->rightPos, leaf, !isDummy && right);
+    StartPrefetch(leaf);
+}
+
+/**
+ * Applies rewrite to every block of the ORAM (all buckets and the stash) in
+ * one sequential pass over the store. The access pattern only depends on
+ * the store size, so rewrite must be data-oblivious itself.
+ */
+void ORAM::scanAndRewrite(function<void(Node*) > rewrite) {
+    EvictBuckets();
+    AwaitPrefetch();
+    WriteBack::RamStore().drain();
+    // the pass rewrites every bucket, so a prefetched path is stale
+    prefetchSlots.clear();
+    int batchSize = 10000;
+    Node node;
+    for (long long j = 0; j < bucketCount; j += batchSize) {
+        int count = (int) min((long long) batchSize, bucketCount - j);
+        vector<long long> indexes;
+        for (int i = 0; i < count; i++) {
+            indexes.push_back(j + i);
+        }
+        if (useLocalRamStore) {
+            for (int i = 0; i < count; i++) {
+                block b = localStore->Read(indexes[i]);
+                for (int z = 0; z < Z; z++) {
+                    std::memcpy(&node, b.data() + z * blockSize, blockSize);
+                    rewrite(&node);
+                    std::memcpy(b.data() + z * blockSize, &node, blockSize);
+                }
+                localStore->Write(indexes[i], b);
+            }
+            continue;
+        }
+        char* tmp = new char[count * storeBlockSize];
+        size_t readSize = ocall_nread_ramStore(count, indexes.data(), tmp, count * storeBlockSize);
+        for (int i = 0; i < count; i++) {
+            for (int z = 0; z < Z; z++) {
+                std::memcpy(&node, tmp + i * readSize + z * blockSize, blockSize);
+                rewrite(&node);
+                std::memcpy(tmp + i * readSize + z * blockSize, &node, blockSize);
+            }
+        }
+        ocall_nwrite_ramStore(count, indexes.data(), (const char*) tmp, count * readSize);
+        delete[] tmp;
+    }
+    for (Node* stashNode : stash.nodes) {
+        rewrite(stashNode);
+    }
+}
+
 void ORAM::evict(bool evictBucketsForORAM) {
     double time;
     if (profile) {
@@ -1155,6 +1395,7 @@ unsigned long long ORAM::RandomPath() {
 
 ORAM::ORAM(long long maxSize, vector<Node*>* nodes, 
             map<unsigned long long, unsigned long long> permutation) : gen(rd()) {
+    WriteBack::RamStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = uniform_int_distribution<long long>(0, maxOfRandom - 1);
@@ -1162,12 +1403,12 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
     stash.preAllocate(PERMANENT_STASH_SIZE * 4);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n", (int)depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n", (int)depth);
 
     nextDummyCounter = INF;
     blockSize = sizeof (Node); // B  
-    printf("block size is:%d\n", (int)blockSize);
+    LOG_INFO("block size is:%d\n", (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
     storeBlockSize = (size_t)Z * (size_t)(blockSize);
     plaintext_size = (blockSize) * Z;
@@ -1182,12 +1423,12 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
 
 
     int i;
-    printf("Setting Nodes Positions\n");
+    LOG_INFO("Setting Nodes Positions\n");
     for (i = 0; i < nodes->size(); i++) {
         (*nodes)[i]->pos = permutation[i];
         (*nodes)[i]->evictionNode = first_leaf + (*nodes)[i]->pos;
     }
-    printf("Adding Dummy Nodes\n");
+    LOG_INFO("Adding Dummy Nodes\n");
     unsigned long long neededDummy = ((bucketCount / 2) * Z);
     for (; i < neededDummy; i++) {
         Node* tmp = new Node();
@@ -1200,7 +1441,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
 
     permutation.clear();
 
-    printf("Sorting\n");
+    LOG_INFO("Sorting\n");
     ObliviousOperations::bitonicSort(nodes);
 
     vector<long long> indexes;
@@ -1210,7 +1451,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
 
     for (int i = 0; i < first_bucket_of_last_level; i++) {
         if (i % 100000 == 0) {
-            printf("Adding Upper Levels Dummy Buckets:%d/%d\n", i,  (int)nodes->size());
+            LOG_INFO("Adding Upper Levels Dummy Buckets:%d/%d\n", i,  (int)nodes->size());
         }
         for (int z = 0; z < Z; z++) {
             Block &curBlock = (*bucket)[z];
@@ -1226,7 +1467,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
 
     for (unsigned int i = 0; i < nodes->size(); i++) {
         if (i % 100000 == 0) {
-            printf("Creating Buckets:%d/%d\n", i, (int)nodes->size());
+            LOG_INFO("Creating Buckets:%d/%d\n", i, (int)nodes->size());
         }
         Node* cureNode = (*nodes)[i];
         long long curBucketID = (*nodes)[i]->evictionNode;
@@ -1279,6 +1520,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes,
 }
 
 ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
+    WriteBack::RamStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = uniform_int_distribution<long long>(0, maxOfRandom - 1);
@@ -1286,12 +1528,12 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
     stash.preAllocate(PERMANENT_STASH_SIZE * 4);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n",  (int)depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n",  (int)depth);
 
     nextDummyCounter = INF;
     blockSize = sizeof (Node); // B  
-    printf("block size is:%d\n",  (int)blockSize);
+    LOG_INFO("block size is:%d\n",  (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
     storeBlockSize = (size_t)Z * (size_t)blockSize;
     plaintext_size = (blockSize) * Z;
@@ -1306,12 +1548,12 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
 
 
     int i;
-    printf("Setting Nodes Eviction ID\n");
+    LOG_INFO("Setting Nodes Eviction ID\n");
     for (i = 0; i < nodes->size(); i++) {
         (*nodes)[i]->evictionNode = (*nodes)[i]->pos + first_leaf;
     }
 
-    printf("Sorting\n");
+    LOG_INFO("Sorting\n");
     ObliviousOperations::bitonicSort(nodes);
 
     vector<long long> indexes;
@@ -1322,7 +1564,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
 
     for (unsigned int i = 0; i < nodes->size(); i++) {
         if (i % 100000 == 0) {
-            printf("Creating Buckets:%d/%d\n",  (int)i,  (int)nodes->size());
+            LOG_INFO("Creating Buckets:%d/%d\n",  (int)i,  (int)nodes->size());
         }
         Node* cureNode = (*nodes)[i];
         long long curBucketID = (*nodes)[i]->evictionNode;
@@ -1368,7 +1610,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
 
     for (int i = 0; i < first_bucket_of_last_level; i++) {
         if (i % 100000 == 0) {
-            printf("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
+            LOG_INFO("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
         }
         for (int z = 0; z < Z; z++) {
             Block &curBlock = (*bucket)[z];
@@ -1408,6 +1650,7 @@ ORAM::ORAM(long long maxSize, vector<Node*>* nodes) : gen(rd()) {
 }
 
 ORAM::ORAM(long long maxSize, int nodesSize) : gen(rd()) {
+    WriteBack::RamStore().drain();
     depth = (int) (ceil(log2(maxSize)) - 1) + 1;
     maxOfRandom = (long long) (pow(2, depth));
     dis = uniform_int_distribution<long long>(0, maxOfRandom - 1);
@@ -1415,12 +1658,12 @@ ORAM::ORAM(long long maxSize, int nodesSize) : gen(rd()) {
     INF = 9223372036854775807 - (bucketCount);
     PERMANENT_STASH_SIZE = 90;
     stash.preAllocate(PERMANENT_STASH_SIZE * 4);
-    printf("Number of leaves:%lld\n", maxOfRandom);
-    printf("depth:%d\n", depth);
+    LOG_INFO("Number of leaves:%lld\n", maxOfRandom);
+    LOG_INFO("depth:%d\n", depth);
 
     nextDummyCounter = INF;
     blockSize = sizeof (Node); // B  
-    printf("block size is:%d\n", (int)blockSize);
+    LOG_INFO("block size is:%d\n", (int)blockSize);
     size_t blockCount = (size_t) (Z * bucketCount);
     storeBlockSize = (size_t)Z * (size_t)(blockSize);
     plaintext_size = (blockSize) * Z;
@@ -1447,7 +1690,7 @@ ORAM::ORAM(long long maxSize, int nodesSize) : gen(rd()) {
     unsigned int k = 0;
     Bucket* bucket = new Bucket();
 
-    printf("Setting Nodes Eviction ID\n");
+    LOG_INFO("Setting Nodes Eviction ID\n");
     for (int i = 0; i < nodesSize; i++) {
         Node* node = getNode(i);
         node->evictionNode = node->pos + first_leaf;
@@ -1455,12 +1698,12 @@ ORAM::ORAM(long long maxSize, int nodesSize) : gen(rd()) {
     }
 
     flushCache();
-    printf("Sorting\n");
+    LOG_INFO("Sorting\n");
     ObliviousOperations::bitonicSort(nodesSize);
 
     long long first_bucket_of_last_level = bucketCount / 2;
 
-    printf("Writing Buckets\n");
+    LOG_INFO("Writing Buckets\n");
 
     for (unsigned int j = 0; j <= nodesSize / 10000; j++) {
         char* tmp = new char[10000 * storeBlockSize];
@@ -1494,7 +1737,7 @@ ORAM::ORAM(long long maxSize, int nodesSize) : gen(rd()) {
         delete tmp;
     }
 
-    printf("Writing Upper Level Buckets\n");
+    LOG_INFO("Writing Upper Level Buckets\n");
 
     for (unsigned int j = 0; j <= first_bucket_of_last_level / 10000; j++) {
         char* tmp = new char[10000 * storeBlockSize];
@@ -1693,12 +1936,12 @@ void ORAM::setupInsert(vector<Node*>* nodes) {
 
 
     int i;
-    printf("Setting Nodes Eviction ID\n");
+    LOG_INFO("Setting Nodes Eviction ID\n");
     for (i = 0; i < nodes->size(); i++) {
         (*nodes)[i]->evictionNode = (*nodes)[i]->pos + first_leaf;
     }
 
-    printf("Sorting\n");
+    LOG_INFO("Sorting\n");
     ObliviousOperations::bitonicSort(nodes);
 
 
@@ -1709,7 +1952,7 @@ void ORAM::setupInsert(vector<Node*>* nodes) {
 
     for (int i = 0; i < first_bucket_of_last_level; i++) {
         if (i % 100000 == 0) {
-            printf("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
+            LOG_INFO("Adding Upper Levels Dummy Buckets:%d/%d\n", i, (int)nodes->size());
         }
         for (int z = 0; z < Z; z++) {
             Block &curBlock = (*bucket)[z];
@@ -1725,7 +1968,7 @@ void ORAM::setupInsert(vector<Node*>* nodes) {
 
     for (unsigned int i = 0; i < nodes->size(); i++) {
         if (i % 100000 == 0) {
-            printf("Creating Buckets:%d/%d\n", (int)i, (int)nodes->size());
+            LOG_INFO("Creating Buckets:%d/%d\n", (int)i, (int)nodes->size());
         }
         Node* cureNode = (*nodes)[i];
         long long curBucketID = (*nodes)[i]->evictionNode;
@@ -2,15 +2,37 @@
 #define ORAMENCLAVEINTERFACE_H
 #include "ORAMEnclaveInterface.h"
 #include "OMAP.h"
-//#include "OHeap.h"
 #include "DOHEAP.hpp"
+#include "ArrayHeap.h"
+#include "ShardedArray.h"
+#include "RAMStoreEnclaveInterface.h"
+#include "WriteBack.h"
 #include <string>
 #include "Common.h"
+#include "Log.h"
 #include <assert.h>
 
 static OMAP* omap = NULL;
 static DOHEAP* oheap = NULL;
-//static OHeap* oheap = NULL;
+static int oheapSize = 0;
+static bool oheapDecreaseKeys = false;
+static vector<DOHEAP*> oheaps;
+static int oheapsSize = 0;
+static bool oheapsDecreaseKeys = false;
+static ArrayHeap* arrayHeap = NULL;
+static int arrayHeapSize = 0;
+
+/**
+ * Namespace of the OMAP placed into an oblivious array: key (a, b) is
+ * entry a * width + b
+ */
+struct ArrayNamespace {
+    ShardedArray* array;
+    int count;
+    int width;
+    int shards;
+};
+static map<byte_t, ArrayNamespace> arrayNamespaces;
 
 map<string, string> setupPairs;
 bool setup = false;
@@ -30,13 +52,37 @@ void ecall_setup_omap_with_small_memory(int max_size, long long initialSize) {
     omap = new OMAP(max_size, initialSize);
 }
 
-void ecall_setup_oheap(int maxSize) {
-    oheap = new DOHEAP(maxSize, false);
+void ecall_checkpoint_omap(block* state) {
+    omap->checkpoint(*state);
+}
+
+void ecall_restore_omap(int max_size, const byte_t** state) {
+    omap = OMAP::restore(max_size, *state);
+}
+
+/**
+ * Sets up the heap for maxSize elements, or empties it if it already has
+ * that layout. With decreaseKeys the values are 0..maxSize-1 and op 4
+ * lowers the key of a value (see DOHEAP::execute).
+ */
+void ecall_setup_oheap(int maxSize, bool decreaseKeys) {
+    if (oheap != NULL && oheapSize == maxSize && oheapDecreaseKeys == decreaseKeys) {
+        oheap->reset();
+        return;
+    }
+    delete oheap;
+    for (DOHEAP* heap : oheaps) {
+        delete heap;
+    }
+    oheaps.clear();
+    oheap = new DOHEAP(maxSize, false, -1, decreaseKeys);
+    oheapSize = maxSize;
+    oheapDecreaseKeys = decreaseKeys;
 }
 
 void ecall_set_new_minheap_node(int newMinHeapNodeV, int newMinHeapNodeDist) {
     //    oheap->setNewMinHeapNode(newMinHeapNodeV, newMinHeapNodeDist);
-    std::cout<<"newMinHeapNodeV: "<<newMinHeapNodeV <<", newMinHeapNodeDist: " << newMinHeapNodeDist<<std::endl;
+    LOG_TRACE("newMinHeapNodeV: %d, newMinHeapNodeDist: %d\n", newMinHeapNodeV, newMinHeapNodeDist);
     Bid id = newMinHeapNodeDist;
     array<byte_t, 16> value;
     std::fill(value.begin(), value.end(), 0);
@@ -46,8 +92,30 @@ void ecall_set_new_minheap_node(int newMinHeapNodeV, int newMinHeapNodeDist) {
     oheap->execute(id, value, 2);
 }
 
-void ecall_execute_heap_operation(int* v, int* dist, int op) {
-    //        oheap->execute(*v, *dist, op);
+static void buildHeap(DOHEAP* heap, const int* v, const int* dist, int count) {
+    vector<pair<Bid, array<byte_t, 16> > > items;
+    for (int i = 0; i < count; i++) {
+        array<byte_t, 16> value;
+        std::fill(value.begin(), value.end(), 0);
+        for (int j = 0; j < 4; j++) {
+            value[j] = (byte_t) (v[i] >> (j * 8));
+        }
+        items.push_back(make_pair(Bid(dist[i]), value));
+    }
+    heap->buildHeap(items);
+}
+
+/**
+ * Replaces the content of the heap with the count entries (v[i], dist[i])
+ * in one bulk load (see DOHEAP::buildHeap). The load sorts every slot of
+ * the tree, so it only pays off over inserts for large start sets; a few
+ * entries go in with inserts.
+ */
+void ecall_build_oheap(const int* v, const int* dist, int count) {
+    buildHeap(oheap, v, dist, count);
+}
+
+static void executeHeapOperation(DOHEAP* heap, int* v, int* dist, int op) {
     int d = *dist;
     Bid id = d;
     int val = *v;
@@ -56,12 +124,107 @@ void ecall_execute_heap_operation(int* v, int* dist, int op) {
     for (int i = 0; i < 4; i++) {
         value[i] = (byte_t) (val >> (i * 8));
     }
-    pair<Bid, array<byte_t, 16> > res = oheap->execute(id, value, op);
+    pair<Bid, array<byte_t, 16> > res = heap->execute(id, value, op);
     int rr = res.first.getValue();
     *dist = rr;
     std::memcpy(v, res.second.data(), sizeof (int));
 }
 
+void ecall_execute_heap_operation(int* v, int* dist, int op) {
+    executeHeapOperation(oheap, v, dist, op);
+}
+
+/**
+ * Sets up count heaps of maxSize elements side by side in one heap store,
+ * or empties them if the same layout already exists.
+ */
+void ecall_setup_oheaps(int count, int maxSize, bool decreaseKeys) {
+    if ((int) oheaps.size() == count && oheapsSize == maxSize && oheapsDecreaseKeys == decreaseKeys) {
+        for (DOHEAP* heap : oheaps) {
+            heap->reset();
+        }
+        return;
+    }
+    for (DOHEAP* heap : oheaps) {
+        delete heap;
+    }
+    oheaps.clear();
+    long long slots = DOHEAP::StoreSlots(maxSize);
+    // the single heap may still have buckets queued for the old store
+    WriteBack::HeapStore().drain();
+    ocall_setup_heapStore(slots * count, sizeof (HeapBucket));
+    long long positionSlots = DOHEAP::PositionSlots(maxSize);
+    if (decreaseKeys) {
+        ocall_setup_arrayStore(HEAP_ARRAY_STORE, positionSlots * count, sizeof (ArrayBucket));
+    }
+    for (int i = 0; i < count; i++) {
+        oheaps.push_back(new DOHEAP(maxSize, false, slots * i, decreaseKeys, positionSlots * i));
+    }
+    oheapsSize = maxSize;
+    oheapsDecreaseKeys = decreaseKeys;
+    // the single heap lived in the store that was just replaced
+    delete oheap;
+    oheap = NULL;
+    oheapSize = 0;
+}
+
+void ecall_execute_heap_operation_on(int heap, int* v, int* dist, int op) {
+    executeHeapOperation(oheaps[heap], v, dist, op);
+}
+
+/**
+ * One operation on each of the first count heaps of ecall_setup_oheaps,
+ * (v[i], dist[i], ops[i]) on heap i, in one pass over the heap store (see
+ * DOHEAP::executeBatch). Results come back in v and dist.
+ */
+void ecall_execute_heap_operations(int count, int* v, int* dist, const int* ops) {
+    vector<DOHEAP*> heaps(oheaps.begin(), oheaps.begin() + count);
+    vector<Bid> keys;
+    vector<array<byte_t, 16> > values;
+    for (int i = 0; i < count; i++) {
+        array<byte_t, 16> value;
+        std::fill(value.begin(), value.end(), 0);
+        for (int j = 0; j < 4; j++) {
+            value[j] = (byte_t) (v[i] >> (j * 8));
+        }
+        keys.push_back(Bid(dist[i]));
+        values.push_back(value);
+    }
+    vector<pair<Bid, array<byte_t, 16> > > res = DOHEAP::executeBatch(heaps, keys, values, vector<int>(ops, ops + count));
+    for (int i = 0; i < count; i++) {
+        dist[i] = res[i].first.getValue();
+        std::memcpy(&v[i], res[i].second.data(), sizeof (int));
+    }
+}
+
+/**
+ * ecall_build_oheap for the given heap of ecall_setup_oheaps
+ */
+void ecall_build_oheap_on(int heap, const int* v, const int* dist, int count) {
+    buildHeap(oheaps[heap], v, dist, count);
+}
+
+/**
+ * Sets up the array heap of maxSize entries with ids in [0, maxSize), or
+ * empties it if it already has that size
+ */
+void ecall_setup_array_heap(int maxSize) {
+    if (arrayHeap != NULL && arrayHeapSize == maxSize) {
+        arrayHeap->reset();
+        return;
+    }
+    delete arrayHeap;
+    arrayHeap = new ArrayHeap(maxSize, maxSize);
+    arrayHeapSize = maxSize;
+}
+
+/**
+ * Same operations as ecall_execute_heap_operation on the array heap
+ */
+void ecall_execute_array_heap_operation(int* v, int* dist, int op) {
+    arrayHeap->execute(*v, *dist, op);
+}
+
 void ecall_dummy_heap_op() {
     //    oheap->dummyOperation();
 }
@@ -70,10 +233,104 @@ void ecall_extract_min_id(int* id, int* dist) {
     //    oheap->extractMinID(*id, *dist);
 }
 
+/**
+ * Places the keys (a, b) of the namespace tag, a < count and b < width,
+ * into an oblivious array of the given number of shards instead of the
+ * OMAP. Whether a key goes to the OMAP or to an array depends on its tag
+ * alone, so callers must not pick tags from secret data. The entries of
+ * all placed namespaces start empty.
+ */
+void ecall_place_array_namespace(byte_t tag, int count, int width, int shards) {
+    ArrayNamespace& placed = arrayNamespaces[tag];
+    placed.count = count;
+    placed.width = width;
+    placed.shards = shards;
+    long long slots = 0;
+    for (auto& item : arrayNamespaces) {
+        slots += ShardedArray::StoreSlots((long long) item.second.count * item.second.width, item.second.shards);
+    }
+    ocall_setup_arrayStore(GRAPH_ARRAY_STORE, slots, sizeof (ArrayBucket));
+    long long offset = 0;
+    for (auto& item : arrayNamespaces) {
+        long long size = (long long) item.second.count * item.second.width;
+        delete item.second.array;
+        item.second.array = new ShardedArray(size, item.second.shards, offset, GRAPH_ARRAY_STORE);
+        offset += ShardedArray::StoreSlots(size, item.second.shards);
+    }
+}
+
+/**
+ * The placed namespace of the key, and its index there; NULL if the key
+ * is in the OMAP
+ */
+static ArrayNamespace* placedNamespace(const char *bid, long long& index) {
+    auto item = arrayNamespaces.find((byte_t) bid[0]);
+    if (item == arrayNamespaces.end()) {
+        return NULL;
+    }
+    unsigned int a, b;
+    std::memcpy(&a, bid + 1, sizeof (a));
+    std::memcpy(&b, bid + 5, sizeof (b));
+    if (a >= (unsigned int) item->second.count || b >= (unsigned int) item->second.width) {
+        throw runtime_error("Key outside of its array namespace");
+    }
+    index = (long long) a * item->second.width + b;
+    return &item->second;
+}
+
+/** Accesses to one placed namespace, see arrayAccess */
+struct ArrayBatch {
+    vector<long long> indexes;
+    vector<const char*> values;
+    vector<int> writeModes;
+    vector<char*> results;
+
+    void add(long long index, const char* value, int writeMode, char* result) {
+        indexes.push_back(index);
+        values.push_back(value);
+        writeModes.push_back(writeMode);
+        results.push_back(result);
+    }
+};
+
+/**
+ * One batch of accesses to a placed namespace with the write modes of
+ * OMAP::multiAccess; each result receives the value from before the write
+ */
+static void arrayAccess(ArrayNamespace* placed, const ArrayBatch& batch) {
+    vector<std::array<byte_t, 16> > newValues(batch.indexes.size());
+    for (int r = 0; r < (int) newValues.size(); r++) {
+        newValues[r].fill(0);
+        std::memcpy(newValues[r].data(), batch.values[r], strnlen(batch.values[r], 16));
+    }
+    vector<std::array<byte_t, 16> > old = placed->array->access(batch.indexes, [&](int r, std::array<byte_t, 16>& current) {
+        bool write = Node::CTeq(batch.writeModes[r], (int) WRITE_ALWAYS);
+        write = write || (Node::CTeq(batch.writeModes[r], (int) WRITE_IF_LESS) && Node::CTeq(Node::CTcmp(ORAM::decimalValue(newValues[r]), ORAM::decimalValue(current)), -1));
+        for (int k = 0; k < (int) current.size(); k++) {
+            current[k] = Node::conditional_select(newValues[r][k], current[k], write);
+        }
+    });
+    for (int r = 0; r < (int) old.size(); r++) {
+        std::memcpy(batch.results[r], old[r].data(), 16);
+    }
+}
+
+static void arrayAccess(ArrayNamespace* placed, long long index, const char* value, int writeMode, char* result) {
+    ArrayBatch batch;
+    batch.add(index, value, writeMode, result);
+    arrayAccess(placed, batch);
+}
+
 void ecall_read_node(const char *bid, char* value) {
     string res;
+    long long index;
+    ArrayNamespace* placed = setup ? NULL : placedNamespace(bid, index);
+    if (placed != NULL) {
+        arrayAccess(placed, index, "", WRITE_NONE, value);
+        return;
+    }
     if (setup) {
-        string curkey(bid);
+        string curkey(bid, ID_SIZE);
         res = setupPairs[curkey];
     } else {
         std::array<byte_t, ID_SIZE> id;
@@ -93,24 +350,92 @@ void ecall_read_and_set_node(const char *bid, char* value) {
 }
 
 void ecall_read_write_node(const char *bid, const char* value, char* oldValue) {
+    long long index;
+    ArrayNamespace* placed = placedNamespace(bid, index);
+    if (placed != NULL) {
+        arrayAccess(placed, index, value, WRITE_ALWAYS, oldValue);
+        return;
+    }
     std::array<byte_t, ID_SIZE> id;
     std::memcpy(id.data(), bid, ID_SIZE);
     Bid inputBid(id);
-    string val(value);
-    omap->searchInsert(inputBid, val);
+    string val(value, strnlen(value, 16));
+    string res = omap->searchInsert(inputBid, val);
+    std::memset(oldValue, 0, 16);
+    std::memcpy(oldValue, res.data(), min(res.size(), (size_t) 16));
+}
+
+/**
+ * Fused OMAP access to count keys (see OMAP::multiAccess). Keys are
+ * ID_SIZE bytes, values and results 16 bytes each, and writeModes holds a
+ * ValueWriteMode per key. results receives the values from before the
+ * updates.
+ */
+void ecall_multi_access_nodes(int count, const char *bids, const char *values, const int *writeModes, char *results) {
+    vector<Bid> keys;
+    vector<string> newValues;
+    vector<int> modes;
+    vector<int> omapKeys;
+    // keys of placed namespaces go to their array in one batch each
+    map<ArrayNamespace*, ArrayBatch> batches;
+    for (int i = 0; i < count; i++) {
+        long long index;
+        ArrayNamespace* placed = placedNamespace(bids + i * ID_SIZE, index);
+        if (placed != NULL) {
+            batches[placed].add(index, values + i * 16, writeModes[i], results + i * 16);
+            continue;
+        }
+        std::array<byte_t, ID_SIZE> id;
+        std::memcpy(id.data(), bids + i * ID_SIZE, ID_SIZE);
+        keys.push_back(Bid(id));
+        newValues.push_back(string(values + i * 16, strnlen(values + i * 16, 16)));
+        modes.push_back(writeModes[i]);
+        omapKeys.push_back(i);
+    }
+    for (auto& item : batches) {
+        arrayAccess(item.first, item.second);
+    }
+    if (keys.empty()) {
+        return;
+    }
+    vector<string> res = omap->multiAccess(keys, newValues, modes);
+    for (int j = 0; j < (int) omapKeys.size(); j++) {
+        char* result = results + omapKeys[j] * 16;
+        std::memset(result, 0, 16);
+        std::memcpy(result, res[j].data(), min(res[j].size(), (size_t) 16));
+    }
+}
+
+void ecall_rewrite_prefix(const char *prefix, const char *value) {
+    auto placed = arrayNamespaces.find((byte_t) prefix[0]);
+    if (strlen(prefix) == 1 && placed != arrayNamespaces.end()) {
+        // every entry of the namespace matches, so the array is reloaded
+        std::array<byte_t, 16> entry{};
+        std::memcpy(entry.data(), value, strnlen(value, 16));
+        placed->second.array->fill(entry);
+        return;
+    }
+    omap->rewritePrefix(string(prefix), string(value));
 }
 
 void ecall_write_node(const char *bid, const char* value) {
+    long long index;
+    ArrayNamespace* placed = setup ? NULL : placedNamespace(bid, index);
+    if (placed != NULL) {
+        char oldValue[16];
+        arrayAccess(placed, index, value, WRITE_ALWAYS, oldValue);
+        return;
+    }
     if (setup) {
-        string curKey(bid);
-        string val(value);
+        string curKey(bid, ID_SIZE);
+        string val(value, strnlen(value, 16));
         setupPairs[curKey] = val;
     } else {
         std::array<byte_t, ID_SIZE> id;
         std::memcpy(id.data(), bid, ID_SIZE);
         Bid inputBid(id);
-        string val(value);
-        std::cout << "inserting omap" << std::endl;
+        string val(value, strnlen(value, 16));
+        LOG_TRACE("inserting omap\n");
         omap->insert(inputBid, val);
     }
 }
@@ -0,0 +1,249 @@
+#include "ObliviousArray.h"
+#include "GraphObliviousOperations.h"
+#include "RAMStoreEnclaveInterface.h"
+#include "Log.h"
+#include <cmath>
+#include <stdexcept>
+
+/** Stash slots beyond the Z * (depth + 1) blocks of a fetched path */
+#define ARRAY_STASH_SIZE 90
+/** Buckets per store ocall of a bulk load */
+#define ARRAY_LOAD_BATCH 10000
+
+ObliviousArray::ObliviousArray(long long size, long long storeOffset, int store) : gen(rd()) {
+    this->size = size;
+    this->store = store;
+    depth = (int) ceil(log2(max(size, 1LL)));
+    maxOfRandom = (long long) (pow(2, depth));
+    dis = std::uniform_int_distribution<long long>(0, maxOfRandom - 1);
+    bucketCount = maxOfRandom * 2 - 1;
+    LOG_INFO("Oblivious array of %lld entries, depth:%d\n", size, depth);
+    if (storeOffset < 0) {
+        ocall_setup_arrayStore(store, StoreSlots(size), sizeof (ArrayBucket));
+    }
+    this->storeOffset = max(storeOffset, 0LL);
+    if (size > POSITION_SCAN_SIZE) {
+        positionMap = new ObliviousArray((size + LEAVES_PER_ENTRY - 1) / LEAVES_PER_ENTRY, this->storeOffset + bucketCount, store);
+    }
+    reset();
+}
+
+ObliviousArray::~ObliviousArray() {
+    delete positionMap;
+}
+
+/**
+ * Number of array store slots (buckets) an array of size entries uses,
+ * its position maps included
+ */
+long long ObliviousArray::StoreSlots(long long size) {
+    int depth = (int) ceil(log2(max(size, 1LL)));
+    long long slots = (long long) (pow(2, depth)) * 2 - 1;
+    if (size > POSITION_SCAN_SIZE) {
+        slots += StoreSlots((size + LEAVES_PER_ENTRY - 1) / LEAVES_PER_ENTRY);
+    }
+    return slots;
+}
+
+unsigned long long ObliviousArray::RandomPath() {
+    return dis(gen);
+}
+
+void ObliviousArray::reset() {
+    InitializeBuckets();
+    if (positionMap != NULL) {
+        positionMap->reset();
+    } else {
+        positions.resize(size);
+        for (long long i = 0; i < size; i++) {
+            positions[i] = RandomPath();
+        }
+    }
+    stash.assign(ARRAY_STASH_SIZE + Z * (depth + 1) + 1, ArrayBlock{});
+}
+
+void ObliviousArray::InitializeBuckets() {
+    ArrayBucket bucket{};
+    ocall_initialize_arrayStore(store, storeOffset, storeOffset + bucketCount, (const char*) bucket.data(), sizeof (ArrayBucket));
+}
+
+void ObliviousArray::load(const vector<std::array<byte_t, 16> >& values) {
+    if ((long long) values.size() > size) {
+        throw runtime_error("More values than oblivious array entries");
+    }
+    vector<ArrayBucket> buckets(bucketCount);
+    vector<int> used(bucketCount, 0);
+    stash.assign(stash.size(), ArrayBlock{});
+    vector<unsigned long long> leaves(size);
+    for (long long i = 0; i < size; i++) {
+        leaves[i] = RandomPath();
+        if (i >= (long long) values.size()) {
+            continue;
+        }
+        ArrayBlock block{(unsigned long long) i + 1, leaves[i], values[i]};
+        long long node = leaves[i] + bucketCount / 2;
+        while (used[node] == Z && node > 0) {
+            node = (node + 1) / 2 - 1;
+        }
+        if (used[node] < Z) {
+            buckets[node][used[node]++] = block;
+        } else {
+            StashBlock(block, true);
+        }
+    }
+    for (long long begin = 0; begin < bucketCount; begin += ARRAY_LOAD_BATCH) {
+        long long end = min(begin + ARRAY_LOAD_BATCH, bucketCount);
+        vector<long long> indexes;
+        for (long long node = begin; node < end; node++) {
+            indexes.push_back(storeOffset + node);
+        }
+        ocall_nwrite_arrayStore(store, indexes.size(), indexes.data(), (const char*) (buckets.data() + begin), (end - begin) * sizeof (ArrayBucket));
+    }
+
+    if (positionMap == NULL) {
+        positions = leaves;
+        return;
+    }
+    vector<std::array<byte_t, 16> > packed((size + LEAVES_PER_ENTRY - 1) / LEAVES_PER_ENTRY);
+    for (long long i = 0; i < (long long) values.size(); i++) {
+        unsigned int stored = (unsigned int) leaves[i] + 1;
+        std::memcpy(packed[i / LEAVES_PER_ENTRY].data() + (i % LEAVES_PER_ENTRY) * sizeof (unsigned int), &stored, sizeof (unsigned int));
+    }
+    positionMap->load(packed);
+}
+
+/**
+ * Moves index to leaf and returns its previous leaf, with one scan of the
+ * position map or one access to the recursive one
+ */
+unsigned long long ObliviousArray::UpdatePosition(long long index, unsigned long long leaf) {
+    unsigned long long old = RandomPath();
+    if (positionMap == NULL) {
+        for (long long i = 0; i < size; i++) {
+            bool match = Node::CTeq(i, index);
+            old = Node::conditional_select(positions[i], old, match);
+            positions[i] = Node::conditional_select(leaf, positions[i], match);
+        }
+        return old;
+    }
+    int lane = index % LEAVES_PER_ENTRY;
+    unsigned int stored = 0;
+    positionMap->access(index / LEAVES_PER_ENTRY, [&](std::array<byte_t, 16>& value) {
+        unsigned int leaves[LEAVES_PER_ENTRY];
+        std::memcpy(leaves, value.data(), sizeof (leaves));
+        for (int l = 0; l < LEAVES_PER_ENTRY; l++) {
+            bool match = Node::CTeq(l, lane);
+            stored = Node::conditional_select(leaves[l], stored, match);
+            leaves[l] = Node::conditional_select((unsigned int) leaf + 1, leaves[l], match);
+        }
+        std::memcpy(value.data(), leaves, sizeof (leaves));
+    });
+    // an index without a leaf has no block in the tree yet, any path will do
+    return Node::conditional_select(old, (unsigned long long) stored - 1, Node::CTeq((int) stored, 0));
+}
+
+/**
+ * Store indexes of the buckets on the path to leaf, from the leaf up
+ */
+vector<long long> ObliviousArray::PathBuckets(unsigned long long leaf) {
+    vector<long long> indexes;
+    long long node = leaf + bucketCount / 2;
+    for (int d = depth; d >= 0; d--) {
+        indexes.push_back(storeOffset + node);
+        node = (node + 1) / 2 - 1;
+    }
+    return indexes;
+}
+
+/**
+ * Puts block into the first free stash slot if real is set, scanning the
+ * whole stash either way
+ */
+void ObliviousArray::StashBlock(const ArrayBlock& block, bool real) {
+    bool placed = !real;
+    for (ArrayBlock& slot : stash) {
+        bool take = !placed && Node::CTeq(slot.index, 0ULL);
+        slot = GraphObliviousOperations::conditional_select(block, slot, take);
+        placed = placed || take;
+    }
+    if (!placed) {
+        throw runtime_error("Oblivious array stash overflow");
+    }
+}
+
+void ObliviousArray::ReadPath(const vector<long long>& path) {
+    vector<ArrayBucket> buckets(path.size());
+    vector<long long> indexes = path;
+    ocall_nread_arrayStore(store, indexes.size(), indexes.data(), (char*) buckets.data(), buckets.size() * sizeof (ArrayBucket));
+    for (const ArrayBucket& bucket : buckets) {
+        for (const ArrayBlock& block : bucket) {
+            StashBlock(block, !Node::CTeq(block.index, 0ULL));
+        }
+    }
+}
+
+/**
+ * Refills the path to leaf from the stash, deepest bucket first, and
+ * writes it back with one store ocall
+ */
+void ObliviousArray::EvictPath(unsigned long long leaf, const vector<long long>& path) {
+    vector<ArrayBucket> buckets(path.size());
+    for (int k = 0; k < (int) path.size(); k++) {
+        for (int z = 0; z < Z; z++) {
+            ArrayBlock chosen{};
+            bool done = false;
+            for (ArrayBlock& block : stash) {
+                bool take = !done && !Node::CTeq(block.index, 0ULL) && Node::CTeq(block.pos >> k, leaf >> k);
+                chosen = GraphObliviousOperations::conditional_select(block, chosen, take);
+                block.index = Node::conditional_select(0ULL, block.index, take);
+                done = done || take;
+            }
+            buckets[k][z] = chosen;
+        }
+    }
+    vector<long long> indexes = path;
+    ocall_nwrite_arrayStore(store, indexes.size(), indexes.data(), (const char*) buckets.data(), buckets.size() * sizeof (ArrayBucket));
+}
+
+std::array<byte_t, 16> ObliviousArray::access(long long index, const std::function<void(std::array<byte_t, 16>&)>& update) {
+    accessCount++;
+    unsigned long long newLeaf = RandomPath();
+    unsigned long long leaf = UpdatePosition(index, newLeaf);
+    vector<long long> path = PathBuckets(leaf);
+    ReadPath(path);
+
+    std::array<byte_t, 16> result{};
+    bool found = false;
+    unsigned long long id = (unsigned long long) index + 1;
+    for (const ArrayBlock& block : stash) {
+        bool match = Node::CTeq(block.index, id);
+        result = GraphObliviousOperations::conditional_select(block.value, result, match);
+        found = found || match;
+    }
+    std::array<byte_t, 16> value = result;
+    update(value);
+    for (ArrayBlock& block : stash) {
+        bool match = Node::CTeq(block.index, id);
+        block.value = GraphObliviousOperations::conditional_select(value, block.value, match);
+        block.pos = Node::conditional_select(newLeaf, block.pos, match);
+    }
+    // an index that was never accessed gets its block now
+    StashBlock(ArrayBlock{id, newLeaf, value}, !found);
+
+    EvictPath(leaf, path);
+    return result;
+}
+
+std::array<byte_t, 16> ObliviousArray::access(long long index, const std::array<byte_t, 16>& value, bool write) {
+    return access(index, [&](std::array<byte_t, 16>& current) {
+        current = GraphObliviousOperations::conditional_select(value, current, write);
+    });
+}
+
+std::array<byte_t, 16> ObliviousArray::read(long long index) {
+    return access(index, std::array<byte_t, 16>{}, false);
+}
+
+void ObliviousArray::write(long long index, const std::array<byte_t, 16>& value) {
+    access(index, value, true);
+}
@@ -1,5 +1,6 @@
 #include "ObliviousOperations.h"
 #include <cstring>
+#include <algorithm>
 #include "RAMStoreEnclaveInterface.h"
 long long ObliviousOperations::storeSingleBlockSize;
 long long ObliviousOperations::single_block_clen_size;
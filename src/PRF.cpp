@@ -83,14 +83,8 @@ void PRF::setValue(long long other) {
 }
 
 bool PRF::isZero() {
-    int res = 0;
-    bool found = false;
-    for (int i = PRF_SIZE - 1; i >= 0; i--) {
-        int cmpRes = CTcmp(id[i], 0);
-        res = conditional_select(cmpRes, res, !found);
-        found = conditional_select(true, found, !CTeq(cmpRes, 0) && !found);
-    }
-    return CTeq(res, 0);
+    const std::array<byte_t, PRF_SIZE> zero = {};
+    return CTeq(CTcmp128(id.data(), zero.data()), 0);
 }
 
 void PRF::setToZero() {
@@ -1,16 +1,38 @@
 #include "RAMStore.hpp"
+#include <sys/mman.h>
 
 RAMStore::RAMStore(size_t count, bool simul)
 : store(count), tmpstore(count), prfstore(count) {
     this->simulation = simul;
 }
 
+/**
+ * Store backed by a read-only mapped image of imageCount blocks. Written
+ * blocks are kept in memory and shadow the image, which is never modified.
+ * The store owns the mapping of mappingLength bytes at mapping.
+ */
+RAMStore::RAMStore(size_t num, const byte_t* image, size_t imageCount, size_t imageBlockSize, void* mapping, size_t mappingLength)
+: store(num), tmpstore(0), prfstore(0) {
+    this->simulation = false;
+    this->image = image;
+    this->imageCount = imageCount;
+    this->imageBlockSize = imageBlockSize;
+    this->mapping = mapping;
+    this->mappingLength = mappingLength;
+}
+
 RAMStore::~RAMStore() {
+    if (mapping != NULL) {
+        munmap(mapping, mappingLength);
+    }
 }
 
 block RAMStore::Read(long long pos) {
     if (simulation) {
         return store[0];
+    } else if (image != NULL && store[pos].empty() && (size_t) pos < imageCount) {
+        const byte_t* begin = image + pos * imageBlockSize;
+        return block(begin, begin + imageBlockSize);
     } else {
         return store[pos];
     }
@@ -29,7 +51,7 @@ void RAMStore::CreateRawStore(size_t count) {
 }
 
 void RAMStore::WriteRawStore(long long pos, block b) {
-    tmpstore[pos] = b;
+    tmpstore[pos] = std::move(b);
 }
 
 block RAMStore::ReadRawStore(long long pos) {
@@ -43,3 +65,41 @@ block RAMStore::ReadPRF(long long pos) {
 void RAMStore::WritePRF(long long pos, block b) {
     prfstore[pos] = b;
 }
+
+size_t RAMStore::Size() {
+    return store.size();
+}
+
+size_t RAMStore::ImageCount() {
+    size_t count = store.size();
+    while (count > 0 && store[count - 1].empty() && (image == NULL || count > imageCount)) {
+        count--;
+    }
+    return count;
+}
+
+size_t RAMStore::ImageBlockSize() {
+    for (size_t i = 0; i < store.size(); i++) {
+        if (!store[i].empty()) {
+            return store[i].size();
+        }
+    }
+    return imageBlockSize;
+}
+
+/**
+ * Writes the first ImageCount() blocks back to back; blocks that were never
+ * written are zero-filled so that block i always starts at i * ImageBlockSize().
+ */
+void RAMStore::WriteImage(std::ostream& out) {
+    size_t count = ImageCount();
+    size_t blockSize = ImageBlockSize();
+    block zero(blockSize, 0);
+    for (size_t i = 0; i < count; i++) {
+        block b = Read(i);
+        if (b.size() != blockSize) {
+            b = zero;
+        }
+        out.write((const char*) b.data(), blockSize);
+    }
+}
@@ -2,19 +2,46 @@
 #include "Utilities.h"
 #include <assert.h>
 #include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SNAPSHOT_MAGIC "GOSSNAP5"
+#define SNAPSHOT_ALIGNMENT 4096
 
 static RAMStore* runStore = NULL;
 static RAMStore* setupStore = NULL;
 static RAMStore* heapStore = NULL;
+/** stores of the oblivious arrays, by ArrayStoreId */
+static RAMStore* arrayStores[3] = {NULL, NULL, NULL};
 
 bool setupMode = false;
 
+/**
+ * Creates the heap store, or replaces it if it has fewer than num blocks
+ * (the heaps using the old store must be set up again)
+ */
 void ocall_setup_heapStore(size_t num, int size) {
-    if (heapStore == NULL) {
+    if (heapStore == NULL || heapStore->Size() < num) {
+            delete heapStore;
             heapStore = new RAMStore(num, false);
     }
 }
 
+/**
+ * Creates the given store of oblivious arrays, or replaces it if it has
+ * fewer than num blocks
+ */
+void ocall_setup_arrayStore(int store, size_t num, int size) {
+    if (arrayStores[store] == NULL || arrayStores[store]->Size() < num) {
+        delete arrayStores[store];
+        arrayStores[store] = new RAMStore(num, false);
+    }
+}
+
 void ocall_setup_ramStore(size_t num, int size) {
     if (setupMode) {
         if (setupStore == NULL) {
@@ -57,6 +84,15 @@ void ocall_nwrite_heapStore(size_t blockCount, long long* indexes, const char *b
     }
 }
 
+void ocall_nwrite_arrayStore(int store, size_t blockCount, long long* indexes, const char *blk, size_t len) {
+    assert(len % blockCount == 0);
+    size_t eachSize = len / blockCount;
+    for (unsigned int i = 0; i < blockCount; i++) {
+        block ciphertext(blk + (i * eachSize), blk + (i + 1) * eachSize);
+        arrayStores[store]->Write(indexes[i], ciphertext);
+    }
+}
+
 void ocall_write_rawRamStore(long long index, const char *blk, size_t len) {
     size_t eachSize = len;
     block ciphertext(blk, blk + eachSize);
@@ -123,7 +159,7 @@ void ocall_nwrite_rawRamStore_for_graph(size_t blockCount, long long* indexes, c
     size_t eachSize = len / blockCount;
     for (unsigned int i = 0; i < blockCount; i++) {
         block ciphertext(blk + (i * eachSize), blk + (i + 1) * eachSize);
-        runStore->WriteRawStore(indexes[i], ciphertext);
+        runStore->WriteRawStore(indexes[i], std::move(ciphertext));
     }
 }
 
@@ -149,6 +185,17 @@ size_t ocall_nread_heapStore(size_t blockCount, long long* indexes, char *blk, s
     return resLen;
 }
 
+size_t ocall_nread_arrayStore(int store, size_t blockCount, long long* indexes, char *blk, size_t len) {
+    assert(len % blockCount == 0);
+    size_t resLen = -1;
+    for (unsigned int i = 0; i < blockCount; i++) {
+        block ciphertext = arrayStores[store]->Read(indexes[i]);
+        resLen = ciphertext.size();
+        std::memcpy(blk + i * resLen, ciphertext.data(), ciphertext.size());
+    }
+    return resLen;
+}
+
 size_t ocall_read_rawRamStore(size_t index, char *blk, size_t len) {
     size_t resLen = -1;
     block ciphertext = setupMode ? setupStore->ReadRawStore(index) : runStore->ReadRawStore(index);
@@ -208,6 +255,13 @@ void ocall_initialize_heapStore(long long begin, long long end, const char *blk,
     }
 }
 
+void ocall_initialize_arrayStore(int store, long long begin, long long end, const char *blk, size_t len) {
+    block ciphertext(blk, blk + len);
+    for (long long i = begin; i < end; i++) {
+        arrayStores[store]->Write(i, ciphertext);
+    }
+}
+
 void ocall_write_ramStore(long long index, const char *blk, size_t len) {
     block ciphertext(blk, blk + len);
     if (setupMode) {
@@ -234,3 +288,86 @@ void ocall_nwrite_prf(size_t blockCount, long long* indexes, const char *blk, si
         }
     }
 }
+
+/**
+ * Snapshot file layout: this header, the trusted state blob, then the page
+ * aligned image of the run store. The heap store is left out: the heaps
+ * are query state that every query sets up again, and their trusted state
+ * is not in the blob either.
+ */
+struct SnapshotHeader {
+    char magic[8];
+    uint64_t stateLength;
+    uint64_t stateOffset;
+    uint64_t storeSlots;
+    uint64_t storeCount;
+    uint64_t storeBlockSize;
+    uint64_t storeOffset;
+};
+
+static uint64_t alignSnapshotOffset(uint64_t offset) {
+    return (offset + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+}
+
+void ocall_write_snapshot(const char* path, const char* state, size_t len) {
+    SnapshotHeader header;
+    std::memset(&header, 0, sizeof (header));
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+    header.stateLength = len;
+    header.stateOffset = sizeof (header);
+    header.storeSlots = runStore->Size();
+    header.storeCount = runStore->ImageCount();
+    header.storeBlockSize = runStore->ImageBlockSize();
+    header.storeOffset = alignSnapshotOffset(header.stateOffset + len);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw runtime_error("Cannot create snapshot file");
+    }
+    out.write((const char*) &header, sizeof (header));
+    out.write(state, len);
+    out.seekp(header.storeOffset);
+    runStore->WriteImage(out);
+    if (!out) {
+        throw runtime_error("Cannot write snapshot file");
+    }
+}
+
+void ocall_map_snapshot(const char* path, block* state) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Snapshot file not found");
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw runtime_error("Cannot read snapshot file");
+    }
+    uint64_t fileSize = st.st_size;
+    if (fileSize < sizeof (SnapshotHeader)) {
+        close(fd);
+        throw runtime_error("Invalid snapshot file");
+    }
+    void* addr = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        throw runtime_error("Cannot map snapshot file");
+    }
+    const byte_t* image = (const byte_t*) addr;
+    SnapshotHeader header;
+    std::memcpy(&header, image, sizeof (header));
+    // every range of the header has to lie inside the file, checked
+    // without overflow
+    bool valid = std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof (header.magic)) == 0;
+    valid = valid && header.stateOffset <= fileSize && header.stateLength <= fileSize - header.stateOffset;
+    valid = valid && header.storeOffset <= fileSize && header.storeCount <= header.storeSlots;
+    valid = valid && (header.storeCount == 0 || (header.storeBlockSize > 0 && header.storeCount <= (fileSize - header.storeOffset) / header.storeBlockSize));
+    if (!valid) {
+        munmap(addr, fileSize);
+        throw runtime_error("Invalid snapshot file");
+    }
+    state->assign(image + header.stateOffset, image + header.stateOffset + header.stateLength);
+
+    delete runStore;
+    runStore = new RAMStore(header.storeSlots, image + header.storeOffset, header.storeCount, header.storeBlockSize, addr, fileSize);
+}
@@ -0,0 +1,258 @@
+#include "ShardedArray.h"
+#include "GraphObliviousOperations.h"
+#include "RAMStoreEnclaveInterface.h"
+#include "Log.h"
+#include <cmath>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <openssl/rand.h>
+
+ShardedArray::ShardedArray(long long size, int shardCount, long long storeOffset, int store) {
+    this->size = size;
+    this->shardCount = max(shardCount, 1);
+    shardSize = (size + this->shardCount - 1) / this->shardCount;
+    long long slots = ObliviousArray::StoreSlots(shardSize);
+    if (storeOffset < 0) {
+        ocall_setup_arrayStore(store, slots * this->shardCount, sizeof (ArrayBucket));
+    }
+    storeOffset = max(storeOffset, 0LL);
+    for (int p = 0; p < this->shardCount; p++) {
+        shards.push_back(new ObliviousArray(shardSize, storeOffset + slots * p, store));
+    }
+
+    std::array<byte_t, 16> key;
+    if (RAND_bytes(key.data(), key.size()) != 1) {
+        throw runtime_error("Failed to create the shard permutation key");
+    }
+    prf = EVP_CIPHER_CTX_new();
+    if (prf == NULL || EVP_EncryptInit_ex(prf, EVP_aes_128_ecb(), NULL, key.data(), NULL) != 1) {
+        throw runtime_error("Failed to initialise the shard permutation");
+    }
+    EVP_CIPHER_CTX_set_padding(prf, 0);
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    std::uniform_int_distribution<long long> dis(0, max(size, 1LL) - 1);
+    rounds = SWAP_OR_NOT_ROUNDS_PER_BIT * max((int) ceil(log2(max(size, 2LL))), 1);
+    for (int r = 0; r < rounds; r++) {
+        roundKeys.push_back(dis(gen));
+    }
+    if (std::thread::hardware_concurrency() > 1) {
+        for (int p = 1; p < this->shardCount; p++) {
+            workers.push_back(std::thread(&ShardedArray::Work, this, p));
+        }
+    }
+    LOG_INFO("Sharded array of %lld entries in %d shards\n", size, this->shardCount);
+}
+
+ShardedArray::~ShardedArray() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        stop = true;
+    }
+    poolChanged.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    for (ObliviousArray* shard : shards) {
+        delete shard;
+    }
+    EVP_CIPHER_CTX_free(prf);
+}
+
+long long ShardedArray::StoreSlots(long long size, int shardCount) {
+    shardCount = max(shardCount, 1);
+    return ObliviousArray::StoreSlots((size + shardCount - 1) / shardCount) * shardCount;
+}
+
+/**
+ * Mean load of a shard plus the Chernoff margin that keeps the overflow
+ * probability of the batch below 2^-SHARD_OVERFLOW_BITS
+ */
+long long ShardedArray::ShardBatch(long long n, int shardCount) {
+    if (shardCount <= 1) {
+        return n;
+    }
+    double mean = (double) n / shardCount;
+    double lambda = log((double) shardCount) + SHARD_OVERFLOW_BITS * log(2.0);
+    double margin = lambda / 3 + sqrt(lambda * lambda / 9 + 2 * mean * lambda);
+    return min(n, (long long) ceil(mean + margin));
+}
+
+void ShardedArray::Work(int shard) {
+    long long seen = 0;
+    while (true) {
+        const std::function<void(int)>* current;
+        {
+            std::unique_lock<std::mutex> lock(poolMutex);
+            poolChanged.wait(lock, [&]() {
+                return stop || generation != seen;
+            });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+            current = task;
+        }
+        (*current)(shard);
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (--running == 0) {
+            poolChanged.notify_all();
+        }
+    }
+}
+
+void ShardedArray::RunOnShards(const std::function<void(int)>& task) {
+    if (workers.empty()) {
+        for (int p = 0; p < shardCount; p++) {
+            task(p);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        this->task = &task;
+        running = shardCount - 1;
+        generation++;
+    }
+    poolChanged.notify_all();
+    task(0);
+    std::unique_lock<std::mutex> lock(poolMutex);
+    poolChanged.wait(lock, [this]() {
+        return running == 0;
+    });
+}
+
+/**
+ * Applies the swap-or-not permutation to every index. Each round pairs x
+ * with K - x mod size and swaps them if the PRF bit of the larger one is
+ * set; the PRF of a round is one AES call over the whole batch.
+ */
+void ShardedArray::Permute(vector<long long>& indexes) {
+    int n = indexes.size();
+    vector<byte_t> in(n * 16), out(n * 16 + 16);
+    vector<long long> partners(n);
+    for (int r = 0; r < rounds; r++) {
+        long long round = r;
+        for (int i = 0; i < n; i++) {
+            long long x = indexes[i];
+            long long d = roundKeys[r] - x;
+            partners[i] = Node::conditional_select(d + size, d, Node::CTeq(Node::CTcmp(d, 0), -1));
+            long long larger = Node::conditional_select(x, partners[i], Node::CTeq(Node::CTcmp(x, partners[i]), 1));
+            std::memcpy(in.data() + i * 16, &round, sizeof (round));
+            std::memcpy(in.data() + i * 16 + 8, &larger, sizeof (larger));
+        }
+        int len;
+        if (EVP_EncryptUpdate(prf, out.data(), &len, in.data(), n * 16) != 1) {
+            throw runtime_error("Failed to evaluate the shard permutation");
+        }
+        for (int i = 0; i < n; i++) {
+            indexes[i] = Node::conditional_select(partners[i], indexes[i], out[i * 16] & 1);
+        }
+    }
+}
+
+vector<std::array<byte_t, 16> > ShardedArray::access(const vector<long long>& indexes, const std::function<void(int, std::array<byte_t, 16>&)>& update) {
+    int n = indexes.size();
+    vector<std::array<byte_t, 16> > results(n);
+    if (shardCount == 1) {
+        for (int r = 0; r < n; r++) {
+            results[r] = shards[0]->access(indexes[r], [&](std::array<byte_t, 16>& value) {
+                update(r, value);
+            });
+        }
+        return results;
+    }
+
+    long long batch = ShardBatch(n, shardCount);
+    vector<long long> permuted = indexes;
+    Permute(permuted);
+    if (batch == n) {
+        return DirectAccess(permuted, update);
+    }
+    vector<ShardRequest> requests;
+    for (int r = 0; r < n; r++) {
+        requests.push_back(ShardRequest{permuted[r] % shardCount, permuted[r] / shardCount, r, 1, 0, {}});
+    }
+    for (int p = 0; p < shardCount; p++) {
+        for (long long j = 0; j < batch; j++) {
+            requests.push_back(ShardRequest{p, 0, n, 0, 0, {}});
+        }
+    }
+
+    // the real accesses of a shard, then its padding; each shard keeps
+    // its first batch entries
+    GraphObliviousOperations::bitonicSort(&requests, [](const ShardRequest& q) {
+        return ((unsigned long long) q.shard << 1) | (unsigned long long) !q.real;
+    });
+    long long position = 0, shard = -1;
+    bool overflow = false;
+    for (ShardRequest& q : requests) {
+        position = Node::conditional_select(position + 1, 0LL, Node::CTeq(q.shard, shard));
+        shard = q.shard;
+        q.keep = Node::CTeq(Node::CTcmp(position, batch), -1);
+        overflow = overflow || (q.real && !q.keep);
+    }
+    if (overflow) {
+        throw runtime_error("Sharded array batch overflow");
+    }
+    GraphObliviousOperations::bitonicSort(&requests, [](const ShardRequest& q) {
+        return ((unsigned long long) !q.keep << 32) | (unsigned long long) q.shard;
+    });
+    requests.resize(batch * shardCount);
+
+    RunOnShards([&](int p) {
+        for (long long j = p * batch; j < (p + 1) * batch; j++) {
+            ShardRequest& q = requests[j];
+            int request = Node::conditional_select(q.request, 0, q.real);
+            q.result = shards[p]->access(q.local, [&](std::array<byte_t, 16>& value) {
+                std::array<byte_t, 16> updated = value;
+                update(request, updated);
+                value = GraphObliviousOperations::conditional_select(updated, value, q.real);
+            });
+        }
+    });
+
+    GraphObliviousOperations::bitonicSort(&requests, [](const ShardRequest& q) {
+        return ((unsigned long long) !q.real << 32) | (unsigned long long) q.request;
+    });
+    for (int r = 0; r < n; r++) {
+        results[r] = requests[r].result;
+    }
+    return results;
+}
+
+/**
+ * A batch no shard can take fewer than n accesses of: shard p runs access
+ * r of the batch for every r, at the local index of r if r is in shard p
+ * and as a padding access otherwise, so the routing sorts are skipped
+ */
+vector<std::array<byte_t, 16> > ShardedArray::DirectAccess(const vector<long long>& permuted, const std::function<void(int, std::array<byte_t, 16>&)>& update) {
+    int n = permuted.size();
+    vector<vector<std::array<byte_t, 16> > > shardResults(shardCount, vector<std::array<byte_t, 16> >(n));
+    RunOnShards([&](int p) {
+        for (int r = 0; r < n; r++) {
+            bool real = Node::CTeq(permuted[r] % shardCount, (long long) p);
+            long long local = Node::conditional_select(permuted[r] / shardCount, 0LL, real);
+            shardResults[p][r] = shards[p]->access(local, [&](std::array<byte_t, 16>& value) {
+                std::array<byte_t, 16> updated = value;
+                update(r, updated);
+                value = GraphObliviousOperations::conditional_select(updated, value, real);
+            });
+        }
+    });
+    vector<std::array<byte_t, 16> > results(n);
+    for (int r = 0; r < n; r++) {
+        for (int p = 0; p < shardCount; p++) {
+            bool real = Node::CTeq(permuted[r] % shardCount, (long long) p);
+            results[r] = GraphObliviousOperations::conditional_select(shardResults[p][r], results[r], real);
+        }
+    }
+    return results;
+}
+
+void ShardedArray::fill(const std::array<byte_t, 16>& value) {
+    RunOnShards([&](int p) {
+        shards[p]->load(vector<std::array<byte_t, 16> >(shardSize, value));
+    });
+}
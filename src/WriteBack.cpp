@@ -0,0 +1,105 @@
+#include "WriteBack.h"
+#include "RAMStoreEnclaveInterface.h"
+#include <cstring>
+
+WriteBack::WriteBack(StoreWrite write) {
+    this->write = write;
+    // with a single hardware thread nothing overlaps, flushes stay in line
+    if (thread::hardware_concurrency() > 1) {
+        worker = thread(&WriteBack::Run, this);
+    }
+}
+
+WriteBack::~WriteBack() {
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stop = true;
+    }
+    changed.notify_all();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+WriteBack& WriteBack::RamStore() {
+    static WriteBack writeBack(ocall_nwrite_ramStore);
+    return writeBack;
+}
+
+WriteBack& WriteBack::HeapStore() {
+    static WriteBack writeBack(ocall_nwrite_heapStore);
+    return writeBack;
+}
+
+void WriteBack::push(vector<long long> indexes, vector<char> data, size_t blockSize) {
+    if (indexes.size() == 0) {
+        return;
+    }
+    if (!worker.joinable()) {
+        Write(indexes, data, blockSize);
+        return;
+    }
+    Flush flush{std::move(indexes), std::move(data), blockSize, {}};
+    for (size_t i = 0; i < flush.indexes.size(); i++) {
+        flush.slots[flush.indexes[i]] = i;
+    }
+    unique_lock<mutex> lock(queueMutex);
+    changed.wait(lock, [this]() {
+        return queue.size() < WRITE_BACK_QUEUE_SIZE;
+    });
+    queue.push_back(std::move(flush));
+    changed.notify_all();
+}
+
+size_t WriteBack::read(const vector<long long>& indexes, char* data, const function<size_t()>& storeRead) {
+    lock_guard<mutex> store(storeMutex);
+    size_t readSize = storeRead();
+    lock_guard<mutex> lock(queueMutex);
+    // later flushes overwrite earlier ones
+    for (const Flush& flush : queue) {
+        for (size_t i = 0; i < indexes.size(); i++) {
+            auto slot = flush.slots.find(indexes[i]);
+            if (slot != flush.slots.end()) {
+                std::memcpy(data + i * readSize, flush.data.data() + slot->second * flush.blockSize, flush.blockSize);
+            }
+        }
+    }
+    return readSize;
+}
+
+void WriteBack::drain() {
+    unique_lock<mutex> lock(queueMutex);
+    changed.wait(lock, [this]() {
+        return queue.empty();
+    });
+}
+
+void WriteBack::Write(vector<long long>& indexes, const vector<char>& data, size_t blockSize) {
+    for (size_t begin = 0; begin < indexes.size(); begin += WRITE_BACK_BATCH) {
+        size_t count = min((size_t) WRITE_BACK_BATCH, indexes.size() - begin);
+        lock_guard<mutex> store(storeMutex);
+        write(count, indexes.data() + begin, data.data() + begin * blockSize, count * blockSize);
+    }
+}
+
+/**
+ * Writes the oldest flush in batches and only then removes it from the
+ * queue, so read() finds each bucket either in the store or in the queue
+ */
+void WriteBack::Run() {
+    unique_lock<mutex> lock(queueMutex);
+    while (true) {
+        changed.wait(lock, [this]() {
+            return stop || !queue.empty();
+        });
+        if (queue.empty()) {
+            return;
+        }
+        Flush& flush = queue.front();
+        lock.unlock();
+        Write(flush.indexes, flush.data, flush.blockSize);
+        lock.lock();
+        queue.pop_front();
+        changed.notify_all();
+    }
+}